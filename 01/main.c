@@ -6,8 +6,15 @@
 
 static char buffer[BUFSIZ];
 
-int ascending_order(const void *a, const void *b) { return *(int *)(a) > *(int *)(b); }
-int check_equal(const void *e, const void *arg) { return *(int *)(e) == *(int *)(arg); }
+int ascending_order(const void *a, const void *b) { return (*(int *)(a) > *(int *)(b)) - (*(int *)(a) < *(int *)(b)); }
+
+/* Add a value's similarity score: the value times how often it appears in each list */
+
+int add_similarity(const void *a, size_t a_count, const void *b, size_t b_count, void *arg) {
+    (void)(b);
+    *(size_t *)(arg) += *(int *)(a) * a_count * b_count;
+    return 0;
+}
 
 int main(int argc, char **argv) {
 
@@ -56,8 +63,10 @@ int main(int argc, char **argv) {
 
     /* Sort the lists */
 
-    list_sort(&ls, ascending_order);
-    list_sort(&rs, ascending_order);
+    if (list_sort_i32(&ls) || list_sort_i32(&rs)) {
+        fprintf(stderr, "Failed to sort the lists.\n");
+        exit(EXIT_FAILURE);
+    }
 
     /* Compute the sum of the distances between each element */
 
@@ -73,27 +82,7 @@ int main(int argc, char **argv) {
     /* Count how many times a unique number in the left list appears in the right list */
 
     sum = 0;
-    // -1 is to ensure that the initial first item is not a number in the list
-    int last_seen = *((int *)list_getindex(&ls, 0)) - 1;
-    int current;
-    size_t last_count;
-
-    for (size_t i = 0; i < list_len(&ls); i++) {
-
-        /* If this number has already been seen, we accounted for it already */
-
-        current = *(int *)(list_getindex(&ls, i));
-        if (current == last_seen) {
-            sum += (current * last_count);
-            continue;
-        }
-
-        /* If it hasn't, then account for it and mark it as seen */
-
-        last_count = list_count(&rs, &current, check_equal);
-        sum += (current * last_count);
-        last_seen = current;
-    }
+    list_merge_join(&ls, &rs, ascending_order, add_similarity, &sum);
 
     printf("%lu\n", sum);
 
@@ -31,6 +31,11 @@ int main(int argc, char **argv) {
     size_t total_pure_safe = 0;
     size_t total_damp_safe = 0;
 
+    /* Reports are short, so one list kept inline is reused for all of them */
+
+    LIST_SMALL(int, 16) report;
+    list_create_small(&report);
+
     while (!feof(puzzle)) {
 
         /* Get next line */
@@ -46,26 +51,30 @@ int main(int argc, char **argv) {
 
         /* Process the line into a list (report) */
 
-        list_t report;
-        list_create(&report, 20, sizeof(int));
+        list_reset(&report.list);
 
         char *number_str = strtok(buffer, " ");
         int number;
 
         do {
             number = atoi(number_str);
-            list_append(&report, &number);
+            list_append(&report.list, &number);
         } while ((number_str = strtok(NULL, " ")) != NULL);
 
         /* Ensure the list meets requirements */
 
-        total_pure_safe += report_safe(&report, false, list_len(&report));
-        total_damp_safe += report_safe(&report, true, list_len(&report));
+        total_pure_safe += report_safe(&report.list, false, list_len(&report.list));
+        total_damp_safe += report_safe(&report.list, true, list_len(&report.list));
     }
 
     printf("%lu\n", total_pure_safe);
     printf("%lu\n", total_damp_safe);
 
+    /* Close input */
+
+    list_destroy(&report.list);
+    fclose(puzzle);
+
     return 0;
 }
 
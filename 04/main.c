@@ -31,6 +31,8 @@ const coord_t DIAGONAL[] = {
     {-1, 1},
 };
 
+static char buffer[BUFSIZ];
+
 int main(int argc, char **argv) {
 
     if (argc != 2) {
@@ -59,24 +61,22 @@ int main(int argc, char **argv) {
     list_t grid;
     list_create(&grid, 100, sizeof(char));
 
-    char c;
     size_t ylen = 0; /* Length of a column (y direction) */
-    while (!feof(puzzle)) {
-
-        c = fgetc(puzzle);
+    while (fgets(buffer, sizeof(buffer), puzzle) != NULL) {
 
-        /* Skip newlines and EOF. */
+        /* Skip the newline and blank lines */
 
-        if (c == '\n' || c == EOF) {
-            ylen++;
-            continue;
-        }
+        size_t len = strcspn(buffer, "\n");
+        if (len == 0) continue;
 
-        /* Append character to grid */
+        /* Append the whole row to the grid at once */
 
-        list_append(&grid, &c);
+        if (list_extend(&grid, buffer, len)) {
+            fprintf(stderr, "Failed to grow the grid.\n");
+            exit(EXIT_FAILURE);
+        }
+        ylen++;
     }
-    ylen--; /* Subtract extra count for EOF */
     size_t xlen = list_len(&grid) / ylen;
 
     /* Recursively count occurrences of the word XMAS from each 'X' */
@@ -51,22 +51,14 @@ int main(int argc, char **argv) {
         before = atoi(strtok(buffer, "|"));
         after = atoi(strtok(NULL, "|"));
 
-        /* If the list of rules for this number exists, add to it */
+        /* Add to the list of rules for this number, creating the list if it does not exist yet */
 
-        list_t *rules = hmap_get(&rulebook, &before);
-        if (rules != NULL) {
-            list_append(rules, &after);
-            continue;
+        int inserted;
+        list_t *rules = hmap_entry(&rulebook, &before, &inserted);
+        if (inserted) {
+            list_create(rules, 20, sizeof(int));
         }
-
-        /* If it does not exist, then create a list. */
-
-        list_t newrules;
-        list_create(&newrules, 20, sizeof(int));
-        list_append(&newrules, &after);
-
-        /* List is copied on put, so it's okay that it was allocated on the stack */
-        hmap_put(&rulebook, &before, &newrules);
+        list_append(rules, &after);
     }
 
     int numbers[] = {47, 61, 75, 29, 53, 97};
@@ -76,7 +68,8 @@ int main(int argc, char **argv) {
 
     /* Iterate over updates */
 
-    list_t update;
+    LIST_SMALL(int, 32) update;
+    list_create_small(&update);
     char *tok;
     int page;
 
@@ -88,27 +81,24 @@ int main(int argc, char **argv) {
 
         /* Parse into an update (list of page numbers) */
 
-        list_create(&update, 50, sizeof(int));
+        list_reset(&update.list);
         tok = strtok(buffer, ",");
         do {
             page = atoi(tok);
-            list_append(&update, &page);
+            list_append(&update.list, &page);
             tok = strtok(NULL, ",");
         } while (tok != NULL);
 
         /* Process update list to verify correct order */
 
-        if (ordered_correctly(&update, &rulebook)) {
-            total_correct += deref(int, list_getindex(&update, list_len(&update) / 2));
+        if (ordered_correctly(&update.list, &rulebook)) {
+            total_correct += deref(int, list_getindex(&update.list, list_len(&update.list) / 2));
         } else {
-            reorder(&update);
-            total_incorrect += deref(int, list_getindex(&update, list_len(&update) / 2));
+            reorder(&update.list);
+            total_incorrect += deref(int, list_getindex(&update.list, list_len(&update.list) / 2));
         }
-
-        /* Delete update list to be made fresh */
-
-        list_destroy(&update);
     }
+    list_destroy(&update.list);
 
     printf("%lu\n", total_correct);
     printf("%lu\n", total_incorrect);
@@ -48,7 +48,7 @@ static int out_of_bounds(coord_t coords, size_t xlen, size_t ylen) {
 static coord_t coord_add(coord_t a, coord_t b) { return (coord_t){.x = a.x + b.x, .y = a.y + b.y}; }
 
 void record_visited(guard_t guard, list_t *grid, size_t xlen, size_t ylen, set_t *visited);
-bool has_loop(guard_t guard, list_t *grid, size_t xlen, size_t ylen);
+bool has_loop(guard_t guard, list_t *grid, size_t xlen, size_t ylen, set_t *visited);
 
 int main(int argc, char **argv) {
 
@@ -108,10 +108,12 @@ int main(int argc, char **argv) {
         .dir = NORTH,
     };
 
-    /* Create a set of visited locations */
+    /* Create a set of visited locations, which can be at most every cell of the grid. It's iterated over below, so keep
+     * the locations dense. */
 
     set_t visited;
-    set_create(&visited, NULL, BUFSIZ, sizeof(coord_t));
+    set_create(&visited, NULL, list_len(&grid), sizeof(coord_t));
+    set_set_dense(&visited, 1);
 
     record_visited(guard, &grid, xlen, ylen, &visited);
 
@@ -122,6 +124,12 @@ int main(int argc, char **argv) {
     char obstacle = OBSTACLE;
     size_t loops = 0;
 
+    /* Every candidate gets a fresh set of visited states, so reuse one set between them. The guard's path with an extra
+     * obstacle is usually about as long as its natural path, and the set grows if it isn't. */
+
+    set_t states;
+    set_create(&states, NULL, set_len(&visited), sizeof(guard_t));
+
     coord_t *loc;
     size_t i = 0;
     while (set_iter(&visited, &i, (void *)&loc) != NULL) {
@@ -131,7 +139,7 @@ int main(int argc, char **argv) {
         if (loc->x == guard.pos.x && loc->y == guard.pos.y) continue;
 
         list_setindex(&grid, loc->y * ylen + loc->x, &obstacle);  /* Place an obstacle at this spot */
-        if (has_loop(guard, &grid, xlen, ylen)) loops++;          /* We found a loop due to this obstacle! */
+        if (has_loop(guard, &grid, xlen, ylen, &states)) loops++; /* We found a loop due to this obstacle! */
         list_setindex(&grid, loc->y * ylen + loc->x, &freespace); /* Remove the obstacle for the next go-round */
     }
 
@@ -141,6 +149,7 @@ int main(int argc, char **argv) {
 
     list_destroy(&grid);
     set_destroy(&visited);
+    set_destroy(&states);
     fclose(puzzle);
 }
 
@@ -149,16 +158,15 @@ int main(int argc, char **argv) {
  * @param grid The map
  * @param xlen The number of columns in the map
  * @param ylen The number of rows in the map
+ * @param visited A set to record the visited states of this run in. It is cleared first.
  * @return True if the guard will loop, false if not
  */
-bool has_loop(guard_t guard, list_t *grid, size_t xlen, size_t ylen) {
-
-    /* Local copy of visited locations for this run */
+bool has_loop(guard_t guard, list_t *grid, size_t xlen, size_t ylen, set_t *visited) {
 
-    set_t visited;
-    set_create(&visited, NULL, BUFSIZ, sizeof(guard_t));
+    /* Fresh copy of visited locations for this run */
 
-    set_add(&visited, &guard.pos); /* Record start position */
+    set_clear(visited);
+    set_add(visited, &guard.pos); /* Record start position */
 
     /* Start state machine logic */
 
@@ -190,17 +198,15 @@ bool has_loop(guard_t guard, list_t *grid, size_t xlen, size_t ylen) {
          * If not, record the state and continue.
          */
 
-        if (set_contains(&visited, &guard)) {
-            set_destroy(&visited);
+        if (set_contains(visited, &guard)) {
             return true;
         }
 
-        set_add(&visited, &guard); /* Record this state */
+        set_add(visited, &guard); /* Record this state */
     }
 
     /* We exited the loop because the guard tried to go out of bounds, so no loop here */
 
-    set_destroy(&visited);
     return false;
 }
 
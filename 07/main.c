@@ -33,6 +33,9 @@ int main(int argc, char **argv) {
 
     size_t total = 0;
     size_t total_with_concat = 0;
+
+    LIST_SMALL(size_t, 16) equation;
+    list_create_small(&equation);
     for (;;) {
 
         /* Get next input line */
@@ -46,31 +49,27 @@ int main(int argc, char **argv) {
 
         /* Add equation values to list */
 
-        list_t equation;
-        list_create(&equation, 15, sizeof(size_t));
+        list_reset(&equation.list);
 
         char *tok;
         size_t cur;
         while ((tok = strtok(NULL, " ")) != NULL) {
             cur = strtoul(tok, NULL, 10);
-            list_append(&equation, &cur);
+            list_append(&equation.list, &cur);
         }
 
         /* Check if equation can be made true */
 
-        if (eq_possible(test, &equation)) {
+        if (eq_possible(test, &equation.list)) {
             total += test;
         }
 
         /* Check if equation can be made true with concatenation */
-        if (eq_possible_with_concat(test, &equation)) {
+        if (eq_possible_with_concat(test, &equation.list)) {
             total_with_concat += test;
         }
-
-        /* Destroy equation once done */
-
-        list_destroy(&equation);
     }
+    list_destroy(&equation.list);
 
     printf("%lu\n", total);
     printf("%lu\n", total_with_concat);
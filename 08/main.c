@@ -9,6 +9,7 @@
 #include "../common/set.h"
 
 #define EMPTY_CELL '.'
+#define ANTINODE_BATCH 32
 #define deref(type, thing) (*((type *)(thing)))
 
 typedef struct {
@@ -76,30 +77,26 @@ int main(int argc, char **argv) {
             antenna.pos.y = ylen;
             antenna.freq = buffer[i];
 
-            /* Check if a list of this frequency already exists */
-
-            list_t *freq_list = hmap_get(&grid, &antenna.freq);
-            if (freq_list != NULL) {
-                list_append(freq_list, &antenna);
-            } else {
-                /* No list exists already, create one */
-                list_t newlist;
-                list_create(&newlist, 5, sizeof(antenna_t));
-                list_append(&newlist, &antenna);
-                hmap_put(&grid, &antenna.freq, &newlist);
+            /* Add to the list of this frequency, creating the list if it does not exist yet */
+
+            int inserted;
+            list_t *freq_list = hmap_entry(&grid, &antenna.freq, &inserted);
+            if (inserted) {
+                list_create(freq_list, 5, sizeof(antenna_t));
             }
+            list_append(freq_list, &antenna);
         }
 
         ylen++;
     }
 
-    /* Create a set for the unique antinode locations */
+    /* Create a set for the unique antinode locations, which can be at most every cell of the grid */
 
     set_t antinodes;
-    set_create(&antinodes, NULL, 1024, sizeof(coord_t));
+    set_create(&antinodes, NULL, xlen * ylen, sizeof(coord_t));
 
     set_t antinodes_all;
-    set_create(&antinodes_all, NULL, 2048, sizeof(coord_t));
+    set_create(&antinodes_all, NULL, xlen * ylen, sizeof(coord_t));
 
     /* Iterate over all the different frequencies */
 
@@ -110,6 +107,7 @@ int main(int argc, char **argv) {
         /* Calculate the antinodes for each pair of antennas within the frequency */
 
         coord_t antipair[2];
+        coord_t pending[ANTINODE_BATCH];
 
         for (size_t i = 0; i < list_len(antennas); i++) {
             for (size_t j = 0; j < list_len(antennas); j++) {
@@ -125,6 +123,7 @@ int main(int argc, char **argv) {
                 int dx = a->pos.x - b->pos.x;
                 int dy = a->pos.y - b->pos.y;
                 int i = 0;
+                size_t npending = 0;
 
                 for (;;) {
 
@@ -143,22 +142,36 @@ int main(int argc, char **argv) {
                         break;
                     }
 
-                    /* Only record the first pair of antinodes for part 1 */
-                    if (i == 1) {
-                        if (!out_of_bounds(&antipair[0], xlen, ylen)) set_add(&antinodes, &antipair[0]);
-                        if (!out_of_bounds(&antipair[1], xlen, ylen)) set_add(&antinodes, &antipair[1]);
+                    /* Queue up the antinodes that are on the map, adding them to the set a batch at a time */
+                    if (npending + 2 > ANTINODE_BATCH) {
+                        set_add_batch(&antinodes_all, pending, npending);
+                        npending = 0;
                     }
 
-                    /* Record all antinodes for part 2 */
-                    if (!out_of_bounds(&antipair[0], xlen, ylen)) set_add(&antinodes_all, &antipair[0]);
-                    if (!out_of_bounds(&antipair[1], xlen, ylen)) set_add(&antinodes_all, &antipair[1]);
+                    size_t n = 0;
+                    if (!out_of_bounds(&antipair[0], xlen, ylen)) pending[npending + n++] = antipair[0];
+                    if (!out_of_bounds(&antipair[1], xlen, ylen)) pending[npending + n++] = antipair[1];
+
+                    /* Only record the first pair of antinodes for part 1. Part 2 records all the others, and takes
+                     * in part 1's at the end. */
+                    if (i == 1) {
+                        set_add_batch(&antinodes, &pending[npending], n);
+                    } else {
+                        npending += n;
+                    }
 
                     i++;
                 }
+
+                set_add_batch(&antinodes_all, pending, npending);
             }
         }
     }
 
+    /* Part 1's antinodes are a subset of part 2's */
+
+    set_union_into(&antinodes_all, &antinodes);
+
     printf("%lu\n", set_len(&antinodes));
     printf("%lu\n", set_len(&antinodes_all));
 
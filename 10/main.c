@@ -5,10 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../common/list.h"
-#include "../common/set.h"
-
-#define deref(type, thing) (*((type *)(thing)))
+#include "../common/typed.h"
 
 #define TRAILHEAD 0
 #define TRAILEND 9
@@ -20,6 +17,9 @@ typedef struct {
     int y;
 } coord_t;
 
+LIST_DECLARE(heightlist, uint8_t)
+SET_DECLARE(coordset, coord_t)
+
 /* Neighbouring cells represented as vectors */
 static const coord_t NEIGHBOURS[] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
 
@@ -31,8 +31,8 @@ static int out_of_bounds(coord_t coords, size_t xlen, size_t ylen) {
     return (coords.x < 0 || coords.y < 0 || coords.x >= xlen || coords.y >= ylen);
 }
 
-size_t num_trails(const list_t *grid, size_t x, size_t y, size_t xlen, size_t ylen);
-size_t trail_rating(const list_t *grid, size_t x, size_t y, size_t xlen, size_t ylen);
+size_t num_trails(const heightlist_t *grid, size_t x, size_t y, size_t xlen, size_t ylen);
+size_t trail_rating(const heightlist_t *grid, size_t x, size_t y, size_t xlen, size_t ylen);
 
 int main(int argc, char **argv) {
 
@@ -50,8 +50,8 @@ int main(int argc, char **argv) {
     }
 
     /* Parse input into a grid */
-    list_t grid;
-    list_create(&grid, 1024, sizeof(uint8_t));
+    heightlist_t grid;
+    heightlist_create(&grid, 1024);
     size_t xlen;
     size_t ylen = 0;
     uint8_t num;
@@ -71,7 +71,7 @@ int main(int argc, char **argv) {
 
         for (size_t i = 0; i < xlen; i++) {
             num = buffer[i] - '0';
-            list_append(&grid, &num);
+            heightlist_append(&grid, num);
         }
     }
 
@@ -81,7 +81,7 @@ int main(int argc, char **argv) {
     size_t ratings = 0;
     for (size_t y = 0; y < ylen; y++) {
         for (size_t x = 0; x < xlen; x++) {
-            if (deref(uint8_t, list_getindex(&grid, y * ylen + x)) == TRAILHEAD) {
+            if (heightlist_get(&grid, y * ylen + x) == TRAILHEAD) {
                 trails += num_trails(&grid, x, y, xlen, ylen);
                 ratings += trail_rating(&grid, x, y, xlen, ylen);
             }
@@ -93,7 +93,7 @@ int main(int argc, char **argv) {
 
     /* Close input */
 
-    list_destroy(&grid);
+    heightlist_destroy(&grid);
     fclose(puzzle);
 }
 
@@ -106,10 +106,10 @@ int main(int argc, char **argv) {
  * @param visited The set of previously visited trail-ends. Leave NULL to record all trail ends
  * @return The number of uniquely possible to visit trail ends
  */
-static size_t look_for(const list_t *grid, coord_t loc, size_t xlen, size_t ylen, set_t *visited) {
+static size_t look_for(const heightlist_t *grid, coord_t loc, size_t xlen, size_t ylen, coordset_t *visited) {
 
     size_t total = 0;
-    uint8_t *self = list_getindex(grid, loc.y * ylen + loc.x);
+    uint8_t *self = heightlist_at(grid, loc.y * ylen + loc.x);
 
     /* This location doesn't exist */
 
@@ -118,10 +118,10 @@ static size_t look_for(const list_t *grid, coord_t loc, size_t xlen, size_t ylen
     /* This location is a trail end, yippee! */
 
     if (*self == TRAILEND) {
-        if (visited != NULL && set_contains(visited, &loc)) {
+        if (visited != NULL && coordset_contains(visited, loc)) {
             return 0;
         } else {
-            if (visited != NULL) set_add(visited, &loc);
+            if (visited != NULL) coordset_add(visited, loc);
             return 1;
         }
     }
@@ -137,7 +137,7 @@ static size_t look_for(const list_t *grid, coord_t loc, size_t xlen, size_t ylen
 
         /* If the neighbour isn't one greater than our current location, skip as well. */
 
-        if (deref(char, list_getindex(grid, neighbour.y * ylen + neighbour.x)) != *self + 1) {
+        if (heightlist_get(grid, neighbour.y * ylen + neighbour.x) != *self + 1) {
             continue;
         }
 
@@ -157,20 +157,23 @@ static size_t look_for(const list_t *grid, coord_t loc, size_t xlen, size_t ylen
  * @param ylen The total number of rows in the topological map
  * @return The total number of uniquely reachable trail ends from the location
  */
-size_t num_trails(const list_t *grid, size_t x, size_t y, size_t xlen, size_t ylen) {
+size_t num_trails(const heightlist_t *grid, size_t x, size_t y, size_t xlen, size_t ylen) {
 
     /* Only trailheads are valid start positions */
 
-    if (deref(uint8_t, list_getindex(grid, y * ylen + x)) != TRAILHEAD) {
+    if (heightlist_get(grid, y * ylen + x) != TRAILHEAD) {
         return 0;
     }
 
     /* Start looking for trail ends! But don't count previously visited trail ends. */
 
-    set_t visited;
-    set_create(&visited, NULL, 50, sizeof(coord_t));
+    coordset_t visited;
+    if (coordset_create(&visited, 50)) {
+        fprintf(stderr, "Failed to allocate the set of visited trail ends.\n");
+        exit(EXIT_FAILURE);
+    }
     size_t total = look_for(grid, (coord_t){.x = x, .y = y}, xlen, ylen, &visited);
-    set_destroy(&visited);
+    coordset_destroy(&visited);
 
     return total;
 }
@@ -183,11 +186,11 @@ size_t num_trails(const list_t *grid, size_t x, size_t y, size_t xlen, size_t yl
  * @param ylen The total number of rows in the topological map
  * @return The trail rating
  */
-size_t trail_rating(const list_t *grid, size_t x, size_t y, size_t xlen, size_t ylen) {
+size_t trail_rating(const heightlist_t *grid, size_t x, size_t y, size_t xlen, size_t ylen) {
 
     /* Only trailheads are valid start positions */
 
-    if (deref(uint8_t, list_getindex(grid, y * ylen + x)) != TRAILHEAD) {
+    if (heightlist_get(grid, y * ylen + x) != TRAILHEAD) {
         return 0;
     }
 
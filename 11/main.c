@@ -7,11 +7,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../common/chmap.h"
 #include "../common/hashmap.h"
 #include "../common/list.h"
 
 #define deref(type, thing) (*((type *)(thing)))
 #define DEFAULT_NUM_BLINKS 25
+#define LOOKUP_BATCH 64
+#define SHARDS_PER_THREAD 8
+#define MAX_THREADS 64 /* Most threads to blink with, which also bounds the per-thread arrays on the stack */
+#define RECIPE_BOOK_ENV "AOC_RECIPES" /* Environment variable naming the file to keep recipes in between runs */
 
 typedef size_t stone_t;
 
@@ -25,9 +30,10 @@ typedef struct {
 static char buffer[BUFSIZ];
 
 static size_t num_blinks = DEFAULT_NUM_BLINKS;
+static size_t num_threads = 1;
 
 void blink(hmap_t *stones, hmap_t *recipes);
-void counter_incr_or_create(hmap_t *counter, stone_t *key, size_t val);
+void blink_parallel(hmap_t *stones, chmap_t *recipes);
 
 int main(int argc, char **argv) {
 
@@ -37,10 +43,17 @@ int main(int argc, char **argv) {
     }
 
     /* We passed in the blink number */
-    if (argc == 3) {
+    if (argc >= 3) {
         num_blinks = strtoul(argv[2], NULL, 10);
     }
 
+    /* We passed in the number of threads to blink with */
+    if (argc >= 4) {
+        num_threads = strtoul(argv[3], NULL, 10);
+        if (num_threads == 0) num_threads = 1;
+        if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+    }
+
     /* Open the puzzle input */
 
     FILE *puzzle = fopen(argv[1], "r");
@@ -51,8 +64,11 @@ int main(int argc, char **argv) {
 
     /* Parse input into stones */
 
+    /* Every blink iterates over the stones, so keep them dense */
+
     hmap_t stones;
-    hmap_create(&stones, NULL, BUFSIZ, sizeof(stone_t), sizeof(size_t));
+    hmap_create(&stones, NULL, BUFSIZ, sizeof(stone_t), sizeof(uint64_t));
+    hmap_set_dense(&stones, 1);
 
     stone_t cur;
     for (;;) {
@@ -69,18 +85,46 @@ int main(int argc, char **argv) {
 
             /* Increase counter of this stone type */
 
-            counter_incr_or_create(&stones, &cur, 1);
+            hmap_add_u64(&stones, &cur, 1);
             tok = strtok(NULL, " ");
         } while (tok != NULL);
     }
 
-    /* Create a hashmap of recipes to cache what each rock's evolution is */
+    /* Create a hashmap of recipes to cache what each rock's evolution is. Threads share theirs. */
+
+    if (num_threads > 1) {
+        chmap_t recipes;
+        if (chmap_create(&recipes, NULL, num_threads * SHARDS_PER_THREAD, BUFSIZ, sizeof(stone_t), sizeof(recipe_t))) {
+            fprintf(stderr, "Failed to create the recipe book.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < num_blinks; i++) {
+            blink_parallel(&stones, &recipes);
+        }
+        chmap_destroy(&recipes);
+    } else {
 
-    hmap_t recipes;
-    hmap_create(&recipes, NULL, BUFSIZ, sizeof(stone_t), sizeof(recipe_t));
+        /* Pick up the recipe book of earlier runs if we're told where it's kept */
+
+        const char *book = getenv(RECIPE_BOOK_ENV);
+        hmap_t recipes;
+        if (book == NULL || hmap_load_mmap(&recipes, NULL, sizeof(stone_t), sizeof(recipe_t), book)) {
+            hmap_create(&recipes, NULL, BUFSIZ, sizeof(stone_t), sizeof(recipe_t));
+        }
+        size_t known = hmap_len(&recipes);
 
-    for (size_t i = 0; i < num_blinks; i++) {
-        blink(&stones, &recipes);
+        for (size_t i = 0; i < num_blinks; i++) {
+            blink(&stones, &recipes);
+        }
+
+        /* Keep any new recipes for the next run */
+
+        if (book != NULL && hmap_len(&recipes) != known) {
+            int err = hmap_save(&recipes, book);
+            if (err) fprintf(stderr, "Failed to save recipe book '%s': %s\n", book, strerror(err));
+        }
+        hmap_destroy(&recipes);
     }
 
     /* Add up all the counter values */
@@ -100,7 +144,6 @@ int main(int argc, char **argv) {
     /* Close input */
 
     hmap_destroy(&stones);
-    hmap_destroy(&recipes);
     fclose(puzzle);
 }
 
@@ -132,145 +175,206 @@ static void split_stone(stone_t *stone, stone_t *remainder) {
     *stone = first_half;
 }
 
-/* Increment the counter associated with `key` if it exists, or start a new counter with initial value `val`.
- * @param counter The hashmap counter
- * @param key The key to increment the count for
- * @param val The amount to increment by
+/* Work out what a stone evolves into.
+ * @param stone The stone to find the recipe of
+ * @return The stone's recipe
  */
-void counter_incr_or_create(hmap_t *counter, stone_t *key, size_t val) {
-    size_t *count = hmap_get(counter, key);
-    if (count == NULL) {
-        hmap_put(counter, key, &val);
-    } else {
-        *count += val;
+static recipe_t make_recipe(stone_t stone) {
+
+    /* If the stone is engraved with the number 0, it is replaced by a stone engraved with the number 1. */
+
+    if (stone == 0) {
+        return (recipe_t){.replace = 1, .dual = false};
     }
-}
 
-/* Calculate the result of a blink and update the list.
- * @param stones The current roster of stones
- * @param recipes A place to store stone's states of evolution as they are discovered
- */
-void blink(hmap_t *stones, hmap_t *recipes) {
+    /* If the stone is engraved with a number that has an even number of digits, it is replaced by two stones.
+     * The left half of the digits are engraved on the new left stone, and the right half of the digits are
+     * engraved on the new right stone. (The new numbers don't keep extra leading zeroes: 1000 would become
+     * stones 10 and 0.) */
 
-    /* Get a copy of the entries for this iteration */
+    if (num_digits(stone) % 2 == 0) {
+        recipe_t newrecipe = {.replace = stone, .dual = true};
+        split_stone(&newrecipe.replace, &newrecipe.add);
+        return newrecipe;
+    }
 
-    list_t key_list;
-    list_create(&key_list, 100, sizeof(stone_t));
+    /* If none of the other rules apply, the stone is replaced by a new stone; the old stone's number multiplied
+     * by 2024 is engraved on the new stone. */
 
-    list_t count_list;
-    list_create(&count_list, 100, sizeof(size_t));
+    return (recipe_t){.replace = stone * 2024, .dual = false};
+}
+
+/* Get a copy of the entries of the current roster of stones.
+ * @param stones The current roster of stones
+ * @param key_list The list to store the stones in
+ * @param count_list The list to store how many of each stone there are in
+ */
+static void snapshot_stones(hmap_t *stones, list_t *key_list, list_t *count_list) {
+    list_create(key_list, 100, sizeof(stone_t));
+    list_create(count_list, 100, sizeof(size_t));
 
     size_t k = 0;
     stone_t *key;
     size_t *old_count;
     while (hmap_iter_pairs(stones, &k, (void *)&key, (void *)&old_count)) {
         if (*old_count != 0) {
-            list_append(&key_list, key);
-            list_append(&count_list, old_count);
+            list_append(key_list, key);
+            list_append(count_list, old_count);
         }
     }
+}
 
-    /* Iterate over all stones in this list and apply the rules */
-
-    stone_t *cur;
-    size_t *count;
-    size_t *round_count;
-    recipe_t *recipe;
-
-    for (size_t i = 0; i < list_len(&key_list); i++) {
-
-        cur = list_getindex(&key_list, i);
-        round_count = list_getindex(&count_list, i);
-        count = hmap_get(stones, cur);
-        if (*count == 0) continue; /* Skip stones that we have seen but aren't in this round */
-
-        /* Check if we already know the outcome of this stone's evolution */
+/* Calculate the result of a blink and update the list.
+ * @param stones The current roster of stones
+ * @param recipes A place to store stone's states of evolution as they are discovered
+ */
+void blink(hmap_t *stones, hmap_t *recipes) {
 
-        recipe = hmap_get(recipes, cur);
-        if (recipe != NULL) {
+    /* Get a copy of the entries for this iteration */
 
-            *count = *count - *round_count; /* All stones just converted */
+    list_t key_list;
+    list_t count_list;
+    snapshot_stones(stones, &key_list, &count_list);
 
-            /* Record more of this stone's replacement */
+    /* Every stone is independent of the others, so look them up a batch at a time to overlap the cache misses. The
+     * keys are contiguous in the key list. */
 
-            counter_incr_or_create(stones, &recipe->replace, *round_count);
+    size_t nkeys = list_len(&key_list);
+    void *found[LOOKUP_BATCH];
 
-            /* If this recipe calls for a new stone, add it */
+    /* All stones just converted */
 
-            if (recipe->dual) counter_incr_or_create(stones, &recipe->add, *round_count);
+    for (size_t start = 0; start < nkeys; start += LOOKUP_BATCH) {
+        size_t len = nkeys - start < LOOKUP_BATCH ? nkeys - start : LOOKUP_BATCH;
+        hmap_get_batch(stones, list_getindex(&key_list, start), len, found);
 
-            continue;
+        for (size_t i = 0; i < len; i++) {
+            deref(uint64_t, found[i]) -= deref(size_t, list_getindex(&count_list, start + i));
         }
+    }
 
-        /* If the stone is engraved with the number 0, it is replaced by a stone engraved with the number 1. */
-
-        if (*cur == 0) {
-
-            /* Update the recipe book */
-
-            recipe_t newrecipe = {.replace = 1, .dual = false};
-            hmap_put(recipes, cur, &newrecipe);
-
-            /* Update the counter */
-
-            *count = *count - *round_count; /* All stones just converted */
+    /* Record more of each stone's replacement, and the new stone if the recipe calls for one */
 
-            /* All 0 stones became '1' stones */
+    for (size_t start = 0; start < nkeys; start += LOOKUP_BATCH) {
+        size_t len = nkeys - start < LOOKUP_BATCH ? nkeys - start : LOOKUP_BATCH;
+        stone_t *keys = list_getindex(&key_list, start);
 
-            counter_incr_or_create(stones, &newrecipe.replace, *round_count);
+        /* Learn the recipes we don't know yet. Adding to the recipe book invalidates the references into it, so look
+         * the block up again afterwards. */
 
-            continue;
+        if (hmap_get_batch(recipes, keys, len, found) < len) {
+            for (size_t i = 0; i < len; i++) {
+                if (found[i] == NULL) {
+                    recipe_t newrecipe = make_recipe(keys[i]);
+                    hmap_put(recipes, &keys[i], &newrecipe);
+                }
+            }
+            hmap_get_batch(recipes, keys, len, found);
         }
 
-        /* If the stone is engraved with a number that has an even number of digits, it is replaced by two stones.
-         * The left half of the digits are engraved on the new left stone, and the right half of the digits are
-         * engraved on the new right stone. (The new numbers don't keep extra leading zeroes: 1000 would become
-         * stones 10 and 0.) */
+        for (size_t i = 0; i < len; i++) {
+            recipe_t *recipe = found[i];
+            size_t round_count = deref(size_t, list_getindex(&count_list, start + i));
 
-        if (num_digits(*cur) % 2 == 0) {
-
-            stone_t prev_cur = *cur; /* Save for recipe book */
+            hmap_add_u64(stones, &recipe->replace, round_count);
+            if (recipe->dual) hmap_add_u64(stones, &recipe->add, round_count);
+        }
+    }
 
-            /* Calculate the two halves */
+    /* Destroy the count list */
 
-            recipe_t newrecipe = {.dual = true};
-            newrecipe.replace = *cur;
-            split_stone(&newrecipe.replace, &newrecipe.add);
+    list_destroy(&key_list);
+    list_destroy(&count_list);
+}
 
-            /* Update the recipe book */
+/* A share of a round's stones for one thread to evolve */
+typedef struct {
+    stone_t const *keys;  /* The stones to evolve */
+    size_t const *counts; /* How many of each stone there are */
+    size_t len;           /* The number of different stones */
+    chmap_t *recipes;     /* The shared recipe book */
+    chmap_t *next;        /* The shared roster of stones after this round */
+} share_t;
+
+/* Evolve one thread's share of the stones into the next round's roster.
+ * @param arg The `share_t` to evolve
+ * @return NULL
+ */
+static void *evolve_share(void *arg) {
+    share_t *share = arg;
 
-            hmap_put(recipes, &prev_cur, &newrecipe);
-            *count = *count - *round_count; /* All stones just converted */
+    for (size_t i = 0; i < share->len; i++) {
 
-            /* Increase the count of the first half */
+        /* Check if we already know the outcome of this stone's evolution, otherwise update the recipe book */
 
-            counter_incr_or_create(stones, &newrecipe.replace, *round_count);
+        recipe_t recipe;
+        if (!chmap_get(share->recipes, &share->keys[i], &recipe)) {
+            recipe = make_recipe(share->keys[i]);
+            chmap_put(share->recipes, &share->keys[i], &recipe);
+        }
 
-            /* Increase the count of the second half */
+        /* All stones just converted */
 
-            counter_incr_or_create(stones, &newrecipe.add, *round_count);
+        chmap_add(share->next, &recipe.replace, share->counts[i]);
+        if (recipe.dual) chmap_add(share->next, &recipe.add, share->counts[i]);
+    }
 
-            continue;
-        }
+    return NULL;
+}
 
-        /* If none of the other rules apply, the stone is replaced by a new stone; the old stone's number multiplied
-         * by 2024 is engraved on the new stone. */
+/* Calculate the result of a blink with `num_threads` threads and replace the roster of stones with it.
+ * @param stones The current roster of stones
+ * @param recipes A place to store stone's states of evolution as they are discovered, shared between the threads
+ */
+void blink_parallel(hmap_t *stones, chmap_t *recipes) {
 
-        /* Update recipe book */
+    list_t key_list;
+    list_t count_list;
+    snapshot_stones(stones, &key_list, &count_list);
 
-        size_t prev = *cur;
-        recipe_t newrecipe = {.replace = prev * 2024, .dual = false};
-        hmap_put(recipes, &prev, &newrecipe);
+    /* Every stone evolves independently, so each thread takes an equal share of them and counts into a shared
+     * roster */
 
-        *count = *count - *round_count; /* All stones just converted */
+    size_t nkeys = list_len(&key_list);
+    chmap_t next;
+    if (chmap_create(&next, NULL, num_threads * SHARDS_PER_THREAD, nkeys * 2, sizeof(stone_t), sizeof(uint64_t))) {
+        fprintf(stderr, "Failed to create the stone roster.\n");
+        exit(EXIT_FAILURE);
+    }
 
-        /* Increase the count of the replacement stone */
+    pthread_t threads[num_threads];
+    share_t shares[num_threads];
+    int started[num_threads];
+
+    for (size_t t = 0; t < num_threads; t++) {
+        size_t start = nkeys * t / num_threads;
+        size_t end = nkeys * (t + 1) / num_threads;
+        shares[t] = (share_t){
+            .keys = list_getindex(&key_list, start),
+            .counts = list_getindex(&count_list, start),
+            .len = end - start,
+            .recipes = recipes,
+            .next = &next,
+        };
+        started[t] = pthread_create(&threads[t], NULL, evolve_share, &shares[t]) == 0;
+
+        /* A share whose thread couldn't be started is evolved on this thread instead */
+
+        if (!started[t]) evolve_share(&shares[t]);
+    }
 
-        counter_incr_or_create(stones, &newrecipe.replace, *round_count);
+    for (size_t t = 0; t < num_threads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
     }
 
-    /* Destroy the count list */
+    /* The new roster replaces the old one */
+
+    hmap_destroy(stones);
+    hmap_create(stones, NULL, chmap_len(&next), sizeof(stone_t), sizeof(uint64_t));
+    hmap_set_dense(stones, 1);
+    chmap_merge_into(&next, stones);
 
+    chmap_destroy(&next);
     list_destroy(&key_list);
     list_destroy(&count_list);
 }
@@ -167,40 +167,32 @@ int main(int argc, char **argv) {
 
 /* Calculates the perimeter of a region.
  * @param region The cells belonging to the region
- * @param xlen The number of columns in the grid
- * @param ylen The number of rows in the grid
  * @param perimeter A set in which to store the cells belonging to the perimeter
  * @return The perimeter length of the region
  */
-static size_t calculate_perimeter(set_t *region, size_t xlen, size_t ylen, set_t *perimeter) {
+static size_t calculate_perimeter(set_t *region, set_t *perimeter) {
 
     /* Iterate over cells in the region and check how many adjacent cells of the same type they have. */
 
     size_t perim = 0;
     coord_t *cell;
     size_t i = 0;
-    while (set_iter(region, &i, (void *)&cell) != NULL) {
-
-        /* Check this cell's neighbours */
+    const size_t num_neighbours = sizeof(NEIGHBOURS) / sizeof(NEIGHBOURS[0]);
+    coord_t neighbours[sizeof(NEIGHBOURS) / sizeof(NEIGHBOURS[0])];
 
-        for (size_t j = 0; j < sizeof(NEIGHBOURS) / sizeof(NEIGHBOURS[0]); j++) {
-            coord_t combined = coord_add(*cell, NEIGHBOURS[j]);
+    while (set_iter(region, &i, (void *)&cell) != NULL) {
 
-            /* If the neighbour is out of bounds, then the cell has a perimeter on this side */
+        /* Check this cell's neighbours all at once. Out of bounds neighbours are never in the region, so the cell has
+         * a perimeter on every side whose neighbour is not in the region. */
 
-            if (out_of_bounds(combined, xlen, ylen)) {
-                set_add(perimeter, cell);
-                perim++;
-                continue;
-            }
-
-            /* If the neighbour is not in the region, then the cell has a perimeter on this side */
+        for (size_t j = 0; j < num_neighbours; j++) {
+            neighbours[j] = coord_add(*cell, NEIGHBOURS[j]);
+        }
 
-            if (!set_contains(region, &combined)) {
-                set_add(perimeter, cell);
-                perim++;
-                continue;
-            }
+        size_t sides = num_neighbours - set_contains_batch(region, neighbours, num_neighbours, NULL);
+        if (sides > 0) {
+            set_add(perimeter, cell);
+            perim += sides;
         }
     }
 
@@ -232,8 +224,9 @@ static size_t calculate_sides(const set_t *perimeter, const set_t *region) {
 
     /* Calculate the perimeter of this perimeter */
 
-    set_t perimperim;
-    set_create(&perimperim, NULL, 256, sizeof(side_t));
+    set_t perimperim; /* Each perimeter cell has at most one side facing out of the region per direction */
+    set_create(&perimperim, NULL, set_len(perimeter) * 4, sizeof(side_t));
+    set_set_probing(&perimperim, SET_ROBIN); /* Sides are removed in bulk below, so avoid piling up deleted slots */
 
     coord_t *cell;
     size_t i = 0;
@@ -259,10 +252,10 @@ static size_t calculate_sides(const set_t *perimeter, const set_t *region) {
      * Then remove them all from the perimeter^2 set. Repeat until perimeter set is empty.
      */
 
-    while (set_len(&perimperim) != 0) {
+    set_t visited;
+    set_create(&visited, NULL, set_len(&perimperim), sizeof(side_t));
 
-        set_t visited;
-        set_create(&visited, NULL, 256, sizeof(side_t));
+    while (set_len(&perimperim) != 0) {
 
         size_t start_i = 0;
         side_t *start = set_iter(&perimperim, &start_i, NULL);
@@ -271,18 +264,16 @@ static size_t calculate_sides(const set_t *perimeter, const set_t *region) {
 
         /* Remove all visited cells */
 
-        start_i = 0;
-        while (set_iter(&visited, &start_i, (void *)&start) != NULL) {
-            set_remove(&perimperim, start);
-        }
+        set_difference_into(&perimperim, &visited);
 
         sides++; /* This means there's been another side */
 
-        /* Destroy visited set for it to be reborn. */
+        /* Clear visited set for it to be reborn. */
 
-        set_destroy(&visited);
+        set_clear(&visited);
     }
 
+    set_destroy(&visited);
     set_destroy(&perimperim);
 
     return sides;
@@ -357,8 +348,8 @@ void record_region(coord_t start, list_t *grid, size_t xlen, size_t ylen, list_t
 
     /* Start flooding from the start location and fill up the set of cells belonging to the region */
 
-    set_t region_cells;
-    set_create(&region_cells, NULL, 2048, sizeof(coord_t));
+    set_t region_cells; /* Grows with the region */
+    set_create(&region_cells, NULL, 0, sizeof(coord_t));
 
     /* Flood out the region! */
 
@@ -366,11 +357,11 @@ void record_region(coord_t start, list_t *grid, size_t xlen, size_t ylen, list_t
 
     /* Calculate the perimeter of the region */
 
-    set_t perimeter;
-    set_create(&perimeter, NULL, 1024, sizeof(coord_t));
+    set_t perimeter; /* Every cell of the region could be on its perimeter */
+    set_create(&perimeter, NULL, set_len(&region_cells), sizeof(coord_t));
     region_t region = {
         .area = set_len(&region_cells),
-        .perimeter = calculate_perimeter(&region_cells, xlen, ylen, &perimeter),
+        .perimeter = calculate_perimeter(&region_cells, &perimeter),
         .sides = calculate_sides(&perimeter, &region_cells),
         .type = deref(char, list_getindex(grid, start.y * ylen + start.x)),
     };
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "../common/bitset.h"
 #include "../common/list.h"
 
 #define deref(type, thing) (*((type *)(thing)))
@@ -106,13 +107,20 @@ int main(int argc, char **argv) {
 
     /* Each second, move the robots */
 
-    int grid[XLEN * YLEN];
+    bitset_t grid;
+    bitset_view_t rows;
+    if (bitset_create(&grid, XLEN * YLEN)) {
+        fprintf(stderr, "Failed to allocate the grid.\n");
+        exit(EXIT_FAILURE);
+    }
+    bitset_view(&rows, &grid, 0, XLEN, YLEN, XLEN);
+
     if (seconds == 0) seconds = SIZE_MAX;
     for (size_t t = 0; t < seconds; t++) {
 
         /* Create grid to show the Christmas tree shape */
 
-        memset(grid, 0, sizeof(grid));
+        bitset_clear(&grid);
 
         /* Iterate over each robot and update its position */
 
@@ -123,7 +131,7 @@ int main(int argc, char **argv) {
 
             /* Put the robot on the grid */
 
-            grid[newpos.y * XLEN + newpos.x] = 1;
+            bitset_view_set(&rows, newpos.x, newpos.y);
         }
 
         /* Print the map if we're looking for the tree */
@@ -132,10 +140,7 @@ int main(int argc, char **argv) {
 
             size_t max_row_sum = 0;
             for (size_t y = 0; y < YLEN; y++) {
-                size_t row_sum = 0;
-                for (size_t x = 0; x < XLEN; x++) {
-                    row_sum += grid[y * XLEN + x];
-                }
+                size_t row_sum = bitset_view_count_row(&rows, y);
                 if (row_sum > max_row_sum) max_row_sum = row_sum;
             }
 
@@ -143,7 +148,7 @@ int main(int argc, char **argv) {
                 printf("Map for second %zu\n", t + 1);
                 for (size_t y = 0; y < YLEN; y++) {
                     for (size_t x = 0; x < XLEN; x++) {
-                        if (grid[y * XLEN + x]) {
+                        if (bitset_view_test(&rows, x, y)) {
                             printf("#");
                         } else {
                             printf(" ");
@@ -206,6 +211,7 @@ int main(int argc, char **argv) {
 
     /* Close input */
 
+    bitset_destroy(&grid);
     list_destroy(&robots);
     fclose(puzzle);
 }
@@ -0,0 +1,335 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bitset.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Words are allocated in whole blocks of this many, aligned to the block, so vector loads never split a block */
+#define BLOCK_WORDS 4
+
+/* Whole-set operations combining two bitsets */
+enum bitop_e {
+    BITOP_AND,    /* Keep bits set in both */
+    BITOP_OR,     /* Keep bits set in either */
+    BITOP_XOR,    /* Keep bits set in exactly one */
+    BITOP_ANDNOT, /* Keep bits set in the first but not the second */
+};
+
+/* Get a mask of the bits below `n` in a word.
+ * @param n The number of low bits to keep, less than 64
+ * @return The mask
+ */
+static uint64_t low_bits(size_t n) { return ((uint64_t)1 << n) - 1; }
+
+/* Zero the bits past the end of the bitset in its last word, after an operation that might have set them.
+ * @param bs The bitset to trim
+ */
+static void trim(bitset_t *bs) {
+    if (bs->len % 64) bs->words[bs->nwords - 1] &= low_bits(bs->len % 64);
+}
+
+/* Create a bitset with every bit unset.
+ * @param bs The bitset to initialize
+ * @param len The number of bits
+ * @return 0 on success, ENOMEM if the bits could not be allocated
+ */
+int bitset_create(bitset_t *bs, size_t len) {
+    bs->len = len;
+    bs->nwords = (len + 63) / 64;
+
+    size_t blocks = bs->nwords ? (bs->nwords + BLOCK_WORDS - 1) / BLOCK_WORDS : 1;
+    bs->words = aligned_alloc(BLOCK_WORDS * sizeof(uint64_t), blocks * BLOCK_WORDS * sizeof(uint64_t));
+    if (bs->words == NULL) {
+        return ENOMEM;
+    }
+    memset(bs->words, 0, blocks * BLOCK_WORDS * sizeof(uint64_t));
+    return 0;
+}
+
+/* Free a bitset.
+ * @param bs The bitset to destroy
+ */
+void bitset_destroy(bitset_t *bs) {
+    free(bs->words);
+    memset(bs, 0, sizeof(bitset_t));
+}
+
+/* Get the length of the bitset.
+ * @param bs The bitset to get the length of
+ * @return The number of bits, set or not
+ */
+size_t bitset_len(bitset_t const *bs) { return bs->len; }
+
+/* Unset every bit.
+ * @param bs The bitset to clear
+ */
+void bitset_clear(bitset_t *bs) { memset(bs->words, 0, bs->nwords * sizeof(uint64_t)); }
+
+/* Combine the words of one bitset into another, a vector of words at a time.
+ * @param dst The words to update
+ * @param src The words to combine into `dst`
+ * @param nwords The number of words
+ * @param op The operation to combine the words with
+ */
+static inline void combine(uint64_t *dst, const uint64_t *src, size_t nwords, enum bitop_e op) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 4 <= nwords; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        switch (op) {
+        case BITOP_AND:
+            a = _mm256_and_si256(a, b);
+            break;
+        case BITOP_OR:
+            a = _mm256_or_si256(a, b);
+            break;
+        case BITOP_XOR:
+            a = _mm256_xor_si256(a, b);
+            break;
+        case BITOP_ANDNOT:
+            a = _mm256_andnot_si256(b, a);
+            break;
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= nwords; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        switch (op) {
+        case BITOP_AND:
+            a = _mm_and_si128(a, b);
+            break;
+        case BITOP_OR:
+            a = _mm_or_si128(a, b);
+            break;
+        case BITOP_XOR:
+            a = _mm_xor_si128(a, b);
+            break;
+        case BITOP_ANDNOT:
+            a = _mm_andnot_si128(b, a);
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+    }
+#endif
+
+    /* Words left over after the last whole vector, or every word without SIMD */
+
+    for (; i < nwords; i++) {
+        switch (op) {
+        case BITOP_AND:
+            dst[i] &= src[i];
+            break;
+        case BITOP_OR:
+            dst[i] |= src[i];
+            break;
+        case BITOP_XOR:
+            dst[i] ^= src[i];
+            break;
+        case BITOP_ANDNOT:
+            dst[i] &= ~src[i];
+            break;
+        }
+    }
+}
+
+/* Keep only the bits set in both bitsets.
+ * @param dst The bitset to update
+ * @param src The other bitset, of the same length
+ * @return 0 on success, EINVAL if the lengths differ
+ */
+int bitset_and(bitset_t *dst, bitset_t const *src) {
+    if (dst->len != src->len) return EINVAL;
+    combine(dst->words, src->words, dst->nwords, BITOP_AND);
+    return 0;
+}
+
+/* Set every bit that is set in `src`.
+ * @param dst The bitset to update
+ * @param src The other bitset, of the same length
+ * @return 0 on success, EINVAL if the lengths differ
+ */
+int bitset_or(bitset_t *dst, bitset_t const *src) {
+    if (dst->len != src->len) return EINVAL;
+    combine(dst->words, src->words, dst->nwords, BITOP_OR);
+    return 0;
+}
+
+/* Flip every bit that is set in `src`.
+ * @param dst The bitset to update
+ * @param src The other bitset, of the same length
+ * @return 0 on success, EINVAL if the lengths differ
+ */
+int bitset_xor(bitset_t *dst, bitset_t const *src) {
+    if (dst->len != src->len) return EINVAL;
+    combine(dst->words, src->words, dst->nwords, BITOP_XOR);
+    return 0;
+}
+
+/* Unset every bit that is set in `src`.
+ * @param dst The bitset to update
+ * @param src The other bitset, of the same length
+ * @return 0 on success, EINVAL if the lengths differ
+ */
+int bitset_andnot(bitset_t *dst, bitset_t const *src) {
+    if (dst->len != src->len) return EINVAL;
+    combine(dst->words, src->words, dst->nwords, BITOP_ANDNOT);
+    return 0;
+}
+
+/* Move every bit `n` places towards the end of the bitset, so bit `i` becomes bit `i + n`. Bits moved past the end are
+ * dropped and the first `n` bits are unset. In a grid stored row after row, shifting by 1 moves every cell one column
+ * right and shifting by the row width moves it one row down.
+ * @param bs The bitset to shift
+ * @param n The number of places to shift by
+ */
+void bitset_shl(bitset_t *bs, size_t n) {
+    if (n >= bs->len) {
+        bitset_clear(bs);
+        return;
+    }
+
+    size_t wshift = n / 64;
+    size_t bshift = n % 64;
+
+    /* Work from the end so every source word is read before it is overwritten */
+
+    for (size_t i = bs->nwords; i-- > wshift;) {
+        uint64_t word = bs->words[i - wshift] << bshift;
+        if (bshift && i > wshift) word |= bs->words[i - wshift - 1] >> (64 - bshift);
+        bs->words[i] = word;
+    }
+    memset(bs->words, 0, wshift * sizeof(uint64_t));
+    trim(bs);
+}
+
+/* Move every bit `n` places towards the start of the bitset, so bit `i + n` becomes bit `i`. The first `n` bits are
+ * dropped and the last `n` bits are unset.
+ * @param bs The bitset to shift
+ * @param n The number of places to shift by
+ */
+void bitset_shr(bitset_t *bs, size_t n) {
+    if (n >= bs->len) {
+        bitset_clear(bs);
+        return;
+    }
+
+    size_t wshift = n / 64;
+    size_t bshift = n % 64;
+    size_t keep = bs->nwords - wshift;
+
+    /* Bits past the end are always zero, so they shift in as zeros */
+
+    for (size_t i = 0; i < keep; i++) {
+        uint64_t word = bs->words[i + wshift] >> bshift;
+        if (bshift && i + wshift + 1 < bs->nwords) word |= bs->words[i + wshift + 1] << (64 - bshift);
+        bs->words[i] = word;
+    }
+    memset(bs->words + keep, 0, wshift * sizeof(uint64_t));
+}
+
+/* Count the set bits.
+ * @param bs The bitset to count
+ * @return The number of set bits
+ */
+size_t bitset_count(bitset_t const *bs) {
+    size_t count = 0;
+    for (size_t i = 0; i < bs->nwords; i++) {
+        count += __builtin_popcountll(bs->words[i]);
+    }
+    return count;
+}
+
+/* Count the set bits with indices in [start, end).
+ * @param bs The bitset to count
+ * @param start The index of the first bit to count
+ * @param end The index after the last bit to count, clamped to the length of the bitset
+ * @return The number of set bits in the range
+ */
+size_t bitset_count_range(bitset_t const *bs, size_t start, size_t end) {
+    if (end > bs->len) end = bs->len;
+    if (start >= end) return 0;
+
+    size_t first = start / 64;
+    size_t last = (end - 1) / 64;
+    uint64_t head = ~low_bits(start % 64);
+    uint64_t tail = end % 64 ? low_bits(end % 64) : ~(uint64_t)0;
+
+    if (first == last) return __builtin_popcountll(bs->words[first] & head & tail);
+
+    size_t count = __builtin_popcountll(bs->words[first] & head) + __builtin_popcountll(bs->words[last] & tail);
+    for (size_t i = first + 1; i < last; i++) {
+        count += __builtin_popcountll(bs->words[i]);
+    }
+    return count;
+}
+
+/* Find the first set bit at or after index `i`. Unset bits are skipped a word at a time.
+ * @param bs The bitset to search
+ * @param i The index to start searching from
+ * @return The index of the set bit, or the length of the bitset if there is none
+ */
+size_t bitset_next(bitset_t const *bs, size_t i) {
+    if (i >= bs->len) return bs->len;
+
+    size_t w = i / 64;
+    uint64_t word = bs->words[w] & ~low_bits(i % 64);
+    while (word == 0) {
+        if (++w == bs->nwords) return bs->len;
+        word = bs->words[w];
+    }
+    return w * 64 + __builtin_ctzll(word);
+}
+
+/* Look at a rectangle of bits in a bitset as a 2D grid.
+ * @param view The view to initialize
+ * @param bs The bitset to look into. The view is valid as long as the bitset is.
+ * @param offset The index of the bit at the top left corner
+ * @param width The number of bits in each row
+ * @param height The number of rows
+ * @param stride The distance between the start of each row in bits, at least `width`
+ * @return 0 on success, EINVAL if the rectangle does not fit in the bitset
+ */
+int bitset_view(bitset_view_t *view, bitset_t *bs, size_t offset, size_t width, size_t height, size_t stride) {
+    if (stride < width || (height > 0 && offset + (height - 1) * stride + width > bs->len)) {
+        return EINVAL;
+    }
+
+    view->bits = bs;
+    view->offset = offset;
+    view->width = width;
+    view->height = height;
+    view->stride = stride;
+    return 0;
+}
+
+/* Count the set bits in row `y` of a view.
+ * @param view The view to count
+ * @param y The row, less than the height of the view
+ * @return The number of set bits in the row
+ */
+size_t bitset_view_count_row(bitset_view_t const *view, size_t y) {
+    size_t start = view->offset + y * view->stride;
+    return bitset_count_range(view->bits, start, start + view->width);
+}
+
+/* Count the set bits in a view.
+ * @param view The view to count
+ * @return The number of set bits in the view
+ */
+size_t bitset_view_count(bitset_view_t const *view) {
+    size_t count = 0;
+    for (size_t y = 0; y < view->height; y++) {
+        count += bitset_view_count_row(view, y);
+    }
+    return count;
+}
@@ -0,0 +1,96 @@
+#ifndef _BITSET_H_
+#define _BITSET_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A fixed length array of bits, for boolean grids and visited markers that would otherwise take a whole `int` or a
+ * hash set slot per cell. Whole-set operations work on a vector of words at a time. Bits past the end of the bitset are
+ * always kept zero, so they never show up in counts or searches.
+ */
+typedef struct {
+    size_t len;      /* Number of bits */
+    size_t nwords;   /* Number of 64-bit words holding the bits */
+    uint64_t *words; /* The bits, bit `i` being bit `i % 64` of word `i / 64` */
+} bitset_t;
+
+/* A rectangle of bits inside a bitset, such as a grid stored one row after another. Rows start `stride` bits apart. */
+typedef struct {
+    bitset_t *bits; /* The bitset the view looks into */
+    size_t offset;  /* Index of the bit at the top left corner */
+    size_t width;   /* Number of bits in each row */
+    size_t height;  /* Number of rows */
+    size_t stride;  /* Distance between the start of each row in bits */
+} bitset_view_t;
+
+int bitset_create(bitset_t *bs, size_t len);
+void bitset_destroy(bitset_t *bs);
+size_t bitset_len(bitset_t const *bs);
+void bitset_clear(bitset_t *bs);
+int bitset_and(bitset_t *dst, bitset_t const *src);
+int bitset_or(bitset_t *dst, bitset_t const *src);
+int bitset_xor(bitset_t *dst, bitset_t const *src);
+int bitset_andnot(bitset_t *dst, bitset_t const *src);
+void bitset_shl(bitset_t *bs, size_t n);
+void bitset_shr(bitset_t *bs, size_t n);
+size_t bitset_count(bitset_t const *bs);
+size_t bitset_count_range(bitset_t const *bs, size_t start, size_t end);
+size_t bitset_next(bitset_t const *bs, size_t i);
+int bitset_view(bitset_view_t *view, bitset_t *bs, size_t offset, size_t width, size_t height, size_t stride);
+size_t bitset_view_count_row(bitset_view_t const *view, size_t y);
+size_t bitset_view_count(bitset_view_t const *view);
+
+/* Single-bit accessors are inline, since they sit in the inner loops of grid searches */
+
+/* Set bit `i`.
+ * @param bs The bitset to update
+ * @param i The index of the bit, less than the length of the bitset
+ */
+static inline void bitset_set(bitset_t *bs, size_t i) { bs->words[i / 64] |= (uint64_t)1 << (i % 64); }
+
+/* Unset bit `i`.
+ * @param bs The bitset to update
+ * @param i The index of the bit, less than the length of the bitset
+ */
+static inline void bitset_unset(bitset_t *bs, size_t i) { bs->words[i / 64] &= ~((uint64_t)1 << (i % 64)); }
+
+/* Check bit `i`.
+ * @param bs The bitset to check
+ * @param i The index of the bit, less than the length of the bitset
+ * @return 1 if the bit is set, 0 otherwise
+ */
+static inline int bitset_test(bitset_t const *bs, size_t i) { return (bs->words[i / 64] >> (i % 64)) & 1; }
+
+/* Set bit `i`, finding out whether it was already set. This is the "mark as visited" step of a search.
+ * @param bs The bitset to update
+ * @param i The index of the bit, less than the length of the bitset
+ * @return 1 if the bit was already set, 0 if this call set it
+ */
+static inline int bitset_test_and_set(bitset_t *bs, size_t i) {
+    uint64_t bit = (uint64_t)1 << (i % 64);
+    int was = (bs->words[i / 64] & bit) != 0;
+    bs->words[i / 64] |= bit;
+    return was;
+}
+
+
+/* Check the bit at column `x` of row `y` of a view.
+ * @param view The view to check
+ * @param x The column, less than the width of the view
+ * @param y The row, less than the height of the view
+ * @return 1 if the bit is set, 0 otherwise
+ */
+static inline int bitset_view_test(bitset_view_t const *view, size_t x, size_t y) {
+    return bitset_test(view->bits, view->offset + y * view->stride + x);
+}
+
+/* Set the bit at column `x` of row `y` of a view.
+ * @param view The view to update
+ * @param x The column, less than the width of the view
+ * @param y The row, less than the height of the view
+ */
+static inline void bitset_view_set(bitset_view_t const *view, size_t x, size_t y) {
+    bitset_set(view->bits, view->offset + y * view->stride + x);
+}
+
+#endif // _BITSET_H_
@@ -0,0 +1,177 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chmap.h"
+
+/* Create a new concurrent hash map. It must not be shared with other threads until this returns.
+ * @param chmap The concurrent hash map to initialize
+ * @param hasher The hash function to use to hash keys. Leave NULL to use `hash_default`.
+ * @param nshards The number of shards to split the map into, rounded up to a power of two. More shards means less
+ * waiting when many threads write at once; a few times the number of threads is plenty.
+ * @param init_cap The total number of pairs to reserve space for. The shards grow past this as needed.
+ * @param keysize The size of the keys in bytes
+ * @param valsize The size of the values in bytes
+ * @return 0 on success, ENOMEM if the shards could not be allocated, or the error from initializing a shard's lock
+ */
+int chmap_create(chmap_t *chmap, hash_f hasher, size_t nshards, size_t init_cap, size_t keysize, size_t valsize) {
+    chmap->hasher = hasher;
+    if (hasher == NULL) {
+        chmap->hasher = hash_default;
+    }
+    chmap->keysize = keysize;
+    chmap->valsize = valsize;
+
+    chmap->nshards = 1;
+    while (chmap->nshards < nshards) {
+        chmap->nshards <<= 1;
+    }
+
+    chmap->shards = aligned_alloc(_Alignof(struct chmap_shard), chmap->nshards * sizeof(struct chmap_shard));
+    if (chmap->shards == NULL) {
+        return ENOMEM;
+    }
+
+    int err = 0;
+    size_t i;
+    for (i = 0; i < chmap->nshards; i++) {
+        err = pthread_mutex_init(&chmap->shards[i].lock, NULL);
+        if (err) break;
+        err = hmap_create(&chmap->shards[i].map, chmap->hasher, init_cap / chmap->nshards, keysize, valsize);
+        if (err) {
+            hmap_destroy(&chmap->shards[i].map);
+            pthread_mutex_destroy(&chmap->shards[i].lock);
+            break;
+        }
+    }
+    if (!err) return 0;
+
+    /* Tear down the shards that were set up before the failure */
+
+    while (i-- > 0) {
+        pthread_mutex_destroy(&chmap->shards[i].lock);
+        hmap_destroy(&chmap->shards[i].map);
+    }
+    free(chmap->shards);
+    chmap->shards = NULL;
+    chmap->nshards = 0;
+    return err;
+}
+
+/* Destroy a concurrent hash map. No other thread may be using it.
+ * @param chmap The concurrent hash map to destroy
+ */
+void chmap_destroy(chmap_t *chmap) {
+    for (size_t i = 0; i < chmap->nshards; i++) {
+        pthread_mutex_destroy(&chmap->shards[i].lock);
+        hmap_destroy(&chmap->shards[i].map);
+    }
+
+    /* No dangling pointers for the shards */
+    free(chmap->shards);
+    chmap->shards = NULL;
+}
+
+/* Find the shard that `key` belongs to, and lock it.
+ * @param chmap The concurrent hash map to search
+ * @param key The key to look for
+ * @return The locked shard
+ */
+static struct chmap_shard *lock_shard(chmap_t *chmap, void const *key) {
+
+    /* The shards' maps pick slots with the low bits of the hash, so pick the shard with the high bits of a remix of it
+     * to keep the two choices independent */
+
+    uint64_t mixed = hash_mix64(chmap->hasher(key, chmap->keysize));
+    struct chmap_shard *shard = &chmap->shards[(mixed >> 32) & (chmap->nshards - 1)];
+    pthread_mutex_lock(&shard->lock);
+    return shard;
+}
+
+/* Get a copy of the value corresponding with `key` if it exists.
+ * @param chmap The concurrent hash map to search
+ * @param key The key to look for
+ * @param val Where to copy the value to. Left untouched if the key does not exist.
+ * @return 1 if the key was found, 0 otherwise
+ */
+int chmap_get(chmap_t *chmap, void const *key, void *val) {
+    struct chmap_shard *shard = lock_shard(chmap, key);
+    void *found = hmap_get(&shard->map, key);
+    if (found != NULL) {
+        memcpy(val, found, chmap->valsize);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return found != NULL;
+}
+
+/* Add or update a pair in the concurrent hash map.
+ * @param chmap The concurrent hash map to update
+ * @param key The key to use for the pair
+ * @param val The value to use for the pair
+ * @return 0 on success, ENOMEM if there was not enough memory to store the pair
+ */
+int chmap_put(chmap_t *chmap, void const *key, void const *val) {
+    struct chmap_shard *shard = lock_shard(chmap, key);
+    int err = hmap_put(&shard->map, key, val);
+    pthread_mutex_unlock(&shard->lock);
+    return err;
+}
+
+/* Add to the counter associated with `key`, starting it at zero if it does not exist yet. The map's values must be
+ * `uint64_t`.
+ * @param chmap The concurrent hash map of counters
+ * @param key The key whose counter to increase
+ * @param delta The amount to increase the counter by
+ * @return 0 on success, ENOMEM if there was not enough memory to store a new counter
+ */
+int chmap_add(chmap_t *chmap, void const *key, uint64_t delta) {
+    struct chmap_shard *shard = lock_shard(chmap, key);
+    int err = hmap_add_u64(&shard->map, key, delta);
+    pthread_mutex_unlock(&shard->lock);
+    return err;
+}
+
+/* Get the number of pairs in the concurrent hash map. Pairs being added or removed while this runs may or may not be
+ * counted.
+ * @param chmap The concurrent hash map to get the length of
+ * @return The number of key, value pairs
+ */
+size_t chmap_len(chmap_t *chmap) {
+    size_t len = 0;
+    for (size_t i = 0; i < chmap->nshards; i++) {
+        pthread_mutex_lock(&chmap->shards[i].lock);
+        len += hmap_len(&chmap->shards[i].map);
+        pthread_mutex_unlock(&chmap->shards[i].lock);
+    }
+    return len;
+}
+
+/* Copy every pair of the concurrent hash map into a regular hash map, replacing the values of keys it already has.
+ * This is the reduction step once the threads filling the concurrent map are done.
+ * @param chmap The concurrent hash map to copy from
+ * @param hmap The hash map to copy into, with the same key and value sizes
+ * @return 0 on success, ENOMEM if `hmap` could not grow to fit the pairs
+ */
+int chmap_merge_into(chmap_t *chmap, hmap_t *hmap) {
+    if (hmap_reserve(hmap, hmap_len(hmap) + chmap_len(chmap))) {
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < chmap->nshards; i++) {
+        struct chmap_shard *shard = &chmap->shards[i];
+        size_t j = 0;
+        void *key;
+        void *val;
+
+        pthread_mutex_lock(&shard->lock);
+        while (hmap_iter_pairs(&shard->map, &j, &key, &val) != NULL) {
+            if (hmap_put(hmap, key, val)) {
+                pthread_mutex_unlock(&shard->lock);
+                return ENOMEM;
+            }
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return 0;
+}
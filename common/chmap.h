@@ -0,0 +1,38 @@
+#ifndef _CHMAP_H_
+#define _CHMAP_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash.h"
+#include "hashmap.h"
+
+/* One independently locked part of a concurrent hash map. Padded to a cache line so that threads working on
+ * neighbouring shards don't contend for the same line. */
+struct chmap_shard {
+    pthread_mutex_t lock; /* Held while the shard's map is accessed */
+    hmap_t map;           /* The pairs whose hash selects this shard */
+} __attribute__((aligned(64)));
+
+/* A hash map that can be shared between threads. Keys are spread over a number of shards by their hash, and each
+ * shard is an `hmap_t` behind its own lock, so threads only wait on each other when they touch the same shard.
+ * Values are copied in and out, since a reference into a shard could be moved by another thread at any time.
+ */
+typedef struct {
+    size_t nshards;             /* Number of shards, always a power of two */
+    size_t keysize;             /* Size of keys */
+    size_t valsize;             /* Size of values */
+    hash_f hasher;              /* Hash function to use */
+    struct chmap_shard *shards; /* The shards */
+} chmap_t;
+
+int chmap_create(chmap_t *chmap, hash_f hasher, size_t nshards, size_t init_cap, size_t keysize, size_t valsize);
+void chmap_destroy(chmap_t *chmap);
+int chmap_get(chmap_t *chmap, void const *key, void *val);
+int chmap_put(chmap_t *chmap, void const *key, void const *val);
+int chmap_add(chmap_t *chmap, void const *key, uint64_t delta);
+size_t chmap_len(chmap_t *chmap);
+int chmap_merge_into(chmap_t *chmap, hmap_t *hmap);
+
+#endif // _CHMAP_H_
@@ -0,0 +1,198 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cset.h"
+
+/* Hashed sets are kept at most half full, so that the probes of concurrent insertions stay short */
+#define CSET_HASH_SLACK 2
+
+/* Create a concurrent set of elements that map onto a bounded range of indices, such as the cells of a grid. The set
+ * takes one bit per index, so membership is decided from a single word no matter how full the set is.
+ * @param cset The concurrent set to initialize
+ * @param range The number of indices elements can map to
+ * @param elemsize The size of each element in bytes
+ * @param index The function mapping elements to indices
+ * @param ctx Passed to `index` with every element, for example the width of the grid
+ * @return 0 on success, ENOMEM if the bits could not be allocated
+ */
+int cset_create_bitset(cset_t *cset, size_t range, size_t elemsize, cset_index_f index, const void *ctx) {
+    cset->mode = CSET_BITSET;
+    cset->elemsize = elemsize;
+    cset->capacity = range;
+    cset->index = index;
+    cset->ctx = ctx;
+    cset->hasher = NULL;
+    atomic_init(&cset->zero, 0);
+
+    cset->words = calloc((range + 63) / 64, sizeof(uint64_t));
+    if (cset->words == NULL) {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/* Create a concurrent set of arbitrary elements up to 8 bytes long, like packed coordinates. Each slot is one word
+ * holding an element's bytes, so inserting is one compare-and-swap on the first empty slot along the probe sequence.
+ * @param cset The concurrent set to initialize
+ * @param hasher The hash function to use. Pass NULL to use `hash_default`
+ * @param max_elems The most elements that will ever be added. The set does not grow.
+ * @param elemsize The size of each element in bytes, at most 8
+ * @return 0 on success, EINVAL if the elements are too big, ENOMEM if the slots could not be allocated
+ */
+int cset_create_hash(cset_t *cset, hash_f hasher, size_t max_elems, size_t elemsize) {
+    if (elemsize == 0 || elemsize > sizeof(uint64_t)) {
+        return EINVAL;
+    }
+
+    cset->mode = CSET_HASH;
+    cset->elemsize = elemsize;
+    cset->index = NULL;
+    cset->ctx = NULL;
+    cset->hasher = hasher;
+    if (hasher == NULL) cset->hasher = hash_default;
+    atomic_init(&cset->zero, 0);
+
+    cset->capacity = 1;
+    while (cset->capacity < max_elems * CSET_HASH_SLACK) {
+        cset->capacity <<= 1;
+    }
+
+    cset->words = calloc(cset->capacity, sizeof(uint64_t));
+    if (cset->words == NULL) {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/* Destroy a concurrent set. No other thread may be using it.
+ * @param cset The concurrent set to destroy
+ */
+void cset_destroy(cset_t *cset) {
+    free((void *)cset->words);
+
+    /* No dangling pointers for the words */
+    cset->words = NULL;
+}
+
+/* Pack an element of a hash mode set into the word that stores it.
+ * @param cset The hash mode set
+ * @param elem The element to pack
+ * @return The element's bytes, zero padded to a word
+ */
+static uint64_t pack(cset_t const *cset, const void *elem) {
+    uint64_t word = 0;
+    memcpy(&word, elem, cset->elemsize);
+    return word;
+}
+
+/* Add an element to the concurrent set, finding out if this call was the one that added it. Only the thread that gets
+ * `inserted` set to 1 for an element should go on to process it, which makes this the "mark as visited" step of a
+ * parallel search.
+ * @param cset The concurrent set to add to
+ * @param elem The element to add
+ * @param inserted Set to 1 if this call added the element, 0 if it was already in the set. Pass NULL to ignore.
+ * @return 0 on success, EINVAL if the element maps outside a bitset's range, ENOSPC if a hash mode set is full
+ */
+int cset_add(cset_t *cset, const void *elem, int *inserted) {
+    int dummy;
+    if (inserted == NULL) inserted = &dummy;
+    *inserted = 0;
+
+    if (cset->mode == CSET_BITSET) {
+        size_t i = cset->index(elem, cset->ctx);
+        if (i >= cset->capacity) return EINVAL;
+
+        /* Check before writing, so that revisiting an element doesn't take the cache line away from other threads */
+
+        uint64_t bit = (uint64_t)1 << (i % 64);
+        _Atomic uint64_t *word = &cset->words[i / 64];
+        if (atomic_load_explicit(word, memory_order_acquire) & bit) return 0;
+        *inserted = !(atomic_fetch_or_explicit(word, bit, memory_order_acq_rel) & bit);
+        return 0;
+    }
+
+    uint64_t key = pack(cset, elem);
+    if (key == 0) {
+        if (atomic_load_explicit(&cset->zero, memory_order_acquire)) return 0;
+        *inserted = !atomic_exchange_explicit(&cset->zero, 1, memory_order_acq_rel);
+        return 0;
+    }
+
+    /* Linear probing, visiting each slot at most once. A slot only ever changes from empty to holding an element, so
+     * when a compare-and-swap loses, the winner's element is in the slot and only needs comparing. */
+
+    size_t mask = cset->capacity - 1;
+    size_t i = cset->hasher(elem, cset->elemsize) & mask;
+    for (size_t n = 0; n < cset->capacity; n++, i = (i + 1) & mask) {
+        uint64_t cur = atomic_load_explicit(&cset->words[i], memory_order_acquire);
+        if (cur == 0) {
+            if (atomic_compare_exchange_strong_explicit(&cset->words[i], &cur, key, memory_order_acq_rel,
+                                                        memory_order_acquire)) {
+                *inserted = 1;
+                return 0;
+            }
+        }
+        if (cur == key) return 0;
+    }
+
+    /* Every slot holds some other element */
+    return ENOSPC;
+}
+
+/* Check if a concurrent set contains an element. An element being added by another thread at the same time may or may
+ * not be seen.
+ * @param cset The concurrent set to check
+ * @param elem The element to look for
+ * @return 1 if the element is in the set, 0 otherwise
+ */
+int cset_contains(cset_t const *cset, const void *elem) {
+    if (cset->mode == CSET_BITSET) {
+        size_t i = cset->index(elem, cset->ctx);
+        if (i >= cset->capacity) return 0;
+        return (atomic_load_explicit(&cset->words[i / 64], memory_order_acquire) >> (i % 64)) & 1;
+    }
+
+    uint64_t key = pack(cset, elem);
+    if (key == 0) return atomic_load_explicit(&cset->zero, memory_order_acquire);
+
+    size_t mask = cset->capacity - 1;
+    size_t i = cset->hasher(elem, cset->elemsize) & mask;
+    for (size_t n = 0; n < cset->capacity; n++, i = (i + 1) & mask) {
+        uint64_t cur = atomic_load_explicit(&cset->words[i], memory_order_acquire);
+        if (cur == key) return 1;
+        if (cur == 0) return 0;
+    }
+    return 0;
+}
+
+/* Count the elements in a concurrent set. This scans the whole set, so it is meant for after the threads are done;
+ * elements added while it runs may or may not be counted.
+ * @param cset The concurrent set to count
+ * @return The number of elements
+ */
+size_t cset_len(cset_t const *cset) {
+    size_t len = 0;
+
+    if (cset->mode == CSET_BITSET) {
+        for (size_t i = 0; i < (cset->capacity + 63) / 64; i++) {
+            len += __builtin_popcountll(atomic_load_explicit(&cset->words[i], memory_order_relaxed));
+        }
+        return len;
+    }
+
+    for (size_t i = 0; i < cset->capacity; i++) {
+        len += atomic_load_explicit(&cset->words[i], memory_order_relaxed) != 0;
+    }
+    return len + atomic_load_explicit(&cset->zero, memory_order_relaxed);
+}
+
+/* Remove every element from a concurrent set, keeping its memory for reuse. No other thread may be using it.
+ * @param cset The concurrent set to clear
+ */
+void cset_clear(cset_t *cset) {
+    size_t words = cset->mode == CSET_BITSET ? (cset->capacity + 63) / 64 : cset->capacity;
+    memset((void *)cset->words, 0, words * sizeof(uint64_t));
+    atomic_store_explicit(&cset->zero, 0, memory_order_relaxed);
+}
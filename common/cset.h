@@ -0,0 +1,49 @@
+#ifndef _CSET_H_
+#define _CSET_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash.h"
+
+/* Storage modes of a concurrent set */
+enum cset_mode_e {
+    CSET_BITSET, /* One bit per possible element, for elements that map onto a bounded range of indices */
+    CSET_HASH,   /* Lock-free open addressing, for sparse elements of up to 8 bytes */
+};
+
+/* Maps an element of a bitset mode concurrent set to its index in the set's range, like a coordinate to its cell.
+ * @param elem The element to map
+ * @param ctx The context given when the set was created, like the width of a grid
+ * @return The index of the element
+ */
+typedef size_t (*cset_index_f)(const void *elem, const void *ctx);
+
+/* A set that many threads can add to and check at once without any locks, for marking things as visited from parallel
+ * searches. Adding is a single test-and-set: exactly one of the threads adding the same element is told it inserted
+ * it. Every operation finishes in a bounded number of steps no matter what other threads do. Lookups are plain atomic
+ * loads, cheap enough for the inner loop of a search.
+ * Elements are never removed while the set is shared, and the set never grows, so it must be created big enough for
+ * everything that will be added to it.
+ */
+typedef struct {
+    enum cset_mode_e mode;   /* Storage mode */
+    size_t elemsize;         /* Size of each element */
+    size_t capacity;         /* Number of bits in the range, or number of slots (a power of two) when hashed */
+    cset_index_f index;      /* Maps elements to bits, only used in bitset mode */
+    const void *ctx;         /* Context passed to `index` */
+    hash_f hasher;           /* Hash function to pick slots with, only used in hash mode */
+    _Atomic uint64_t *words; /* The bits of the range, or the slots holding the elements' bytes */
+    atomic_int zero;         /* 1 if the all-zero element is in a hash mode set, since 0 marks empty slots */
+} cset_t;
+
+int cset_create_bitset(cset_t *cset, size_t range, size_t elemsize, cset_index_f index, const void *ctx);
+int cset_create_hash(cset_t *cset, hash_f hasher, size_t max_elems, size_t elemsize);
+void cset_destroy(cset_t *cset);
+int cset_add(cset_t *cset, const void *elem, int *inserted);
+int cset_contains(cset_t const *cset, const void *elem);
+size_t cset_len(cset_t const *cset);
+void cset_clear(cset_t *cset);
+
+#endif // _CSET_H_
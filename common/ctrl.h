@@ -0,0 +1,166 @@
+#ifndef _CTRL_H_
+#define _CTRL_H_
+
+/* Control bytes shared by the open addressing tables in hashmap.c and set.c.
+ *
+ * Each slot of a table has one control byte. A full slot stores the low 7 bits of its key's hash (H2), so an entire group
+ * of control bytes can be compared against a key's H2 with one vector compare. Only the slots that match need their key
+ * compared. The remaining hash bits (H1) select the group to start probing at. Empty and deleted slots have their high
+ * bit set, which lets free slots be found with a single movemask.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CTRL_EMPTY 0x80 /* Nothing ever lived in this slot */
+#define CTRL_DEL 0xFE   /* Something was here, but got deleted */
+
+#define H1(hash) ((size_t)(hash) >> 7)   /* Hash bits selecting the starting group */
+#define H2(hash) ((uint8_t)((hash)&0x7F)) /* Hash bits stored in a full slot's control byte */
+
+#if defined(__AVX2__)
+#define GROUP_WIDTH 32
+typedef uint32_t groupmask_t;
+#else
+#define GROUP_WIDTH 16
+typedef uint16_t groupmask_t;
+#endif
+
+/* Check if a control byte belongs to a full slot.
+ * @param c The control byte
+ * @return 1 if the slot holds an element, 0 otherwise
+ */
+static inline int ctrl_full(uint8_t c) { return c < CTRL_EMPTY; }
+
+/* Find the slots in a group whose control byte is `c`.
+ * @param ctrl The first control byte of the group
+ * @param c The control byte to look for
+ * @return A bitmask with bit `i` set if slot `i` of the group matches
+ */
+static inline groupmask_t group_match(const uint8_t *ctrl, uint8_t c) {
+#if defined(__AVX2__)
+    __m256i group = _mm256_loadu_si256((const __m256i *)ctrl);
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(group, _mm256_set1_epi8(c)));
+#elif defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+    groupmask_t mask = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (groupmask_t)(ctrl[i] == c) << i;
+    }
+    return mask;
+#endif
+}
+
+/* Find the empty or deleted slots in a group.
+ * @param ctrl The first control byte of the group
+ * @return A bitmask with bit `i` set if slot `i` of the group is free
+ */
+static inline groupmask_t group_match_free(const uint8_t *ctrl) {
+#if defined(__AVX2__)
+    return _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)ctrl));
+#elif defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    groupmask_t mask = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (groupmask_t)(ctrl[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+/* Find the full slots in a group.
+ * @param ctrl The first control byte of the group
+ * @return A bitmask with bit `i` set if slot `i` of the group holds an element
+ */
+static inline groupmask_t group_match_full(const uint8_t *ctrl) { return (groupmask_t)~group_match_free(ctrl); }
+
+/* Find the empty slots in a group.
+ * @param ctrl The first control byte of the group
+ * @return A bitmask with bit `i` set if slot `i` of the group is empty
+ */
+static inline groupmask_t group_match_empty(const uint8_t *ctrl) { return group_match(ctrl, CTRL_EMPTY); }
+
+/* Allocate the control bytes of a table with every slot empty. Groups start at multiples of `GROUP_WIDTH`, so aligning
+ * the array to a group keeps every group load inside one cache line.
+ * @param capacity The number of slots, a power of two no smaller than `GROUP_WIDTH`
+ * @return The control bytes, to be released with `free`, or NULL if they could not be allocated
+ */
+static inline uint8_t *ctrl_alloc(size_t capacity) {
+    uint8_t *ctrl = aligned_alloc(GROUP_WIDTH, capacity);
+    if (ctrl != NULL) memset(ctrl, CTRL_EMPTY, capacity);
+    return ctrl;
+}
+
+/* Get the index of the lowest set bit in a non-zero group mask, then clear that bit.
+ * @param mask The mask to take the bit from
+ * @return The index within the group of the lowest set bit
+ */
+static inline size_t group_next(groupmask_t *mask) {
+    size_t i = __builtin_ctz(*mask);
+    *mask &= *mask - 1;
+    return i;
+}
+
+/* A sequence of groups to probe. Groups are visited in triangular steps, which reaches every group exactly once when the
+ * number of groups is a power of two.
+ */
+struct probeseq {
+    size_t group; /* The current group */
+    size_t step;  /* Distance to the next group */
+    size_t mask;  /* Number of groups minus one */
+};
+
+/* Start probing at the group selected by a hash.
+ * @param hash The full hash of the key being probed for
+ * @param capacity The number of slots in the table, a power of two multiple of `GROUP_WIDTH`
+ * @return The probe sequence, starting at its first group
+ */
+static inline struct probeseq probeseq_start(uint32_t hash, size_t capacity) {
+    size_t mask = capacity / GROUP_WIDTH - 1;
+    return (struct probeseq){.group = H1(hash) & mask, .step = 0, .mask = mask};
+}
+
+/* Advance a probe sequence to its next group.
+ * @param seq The probe sequence
+ */
+static inline void probeseq_next(struct probeseq *seq) {
+    seq->step++;
+    seq->group = (seq->group + seq->step) & seq->mask;
+}
+
+/* Get the index of the first slot in the probe sequence's current group.
+ * @param seq The probe sequence
+ * @return The slot index
+ */
+static inline size_t probeseq_offset(struct probeseq const *seq) { return seq->group * GROUP_WIDTH; }
+
+/* Robin Hood tables reuse the control bytes to store how far each full slot is from its home slot. Distances of
+ * `RH_MAX_DIST` or more are stored as `RH_MAX_DIST` and recomputed from the key's hash when needed.
+ */
+#define RH_MAX_DIST 0x7F
+
+/* Get the home slot of a hash in a Robin Hood table.
+ * @param hash The full hash of the key
+ * @param capacity The number of slots in the table, a power of two
+ * @return The slot index the key would ideally live in
+ */
+static inline size_t rh_home(uint32_t hash, size_t capacity) { return hash & (capacity - 1); }
+
+/* Encode a distance from the home slot as a Robin Hood control byte.
+ * @param dist The distance from the home slot
+ * @return The control byte to store
+ */
+static inline uint8_t rh_ctrl(size_t dist) { return dist < RH_MAX_DIST ? dist : RH_MAX_DIST; }
+
+#endif // _CTRL_H_
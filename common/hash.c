@@ -0,0 +1,275 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+#include "hash.h"
+
+#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8) + (uint32_t)(((const uint8_t *)(d))[0]))
+
+/* Fast hashing function taken from http://www.azillionmonkeys.com/qed/hash.html.
+ * Author: Paul Hsieh
+ * Licensed under LGPL2.1 license.
+ * Should be way better than anything I can make.
+ * @param data The bytes to hash
+ * @param len The number of bytes
+ * @return The hash of `data`
+ */
+uint32_t hash_hsieh(const uint8_t *data, size_t len) {
+    uint32_t hash = len, tmp;
+    int rem;
+
+    if (len <= 0 || data == NULL) return 0;
+
+    rem = len & 3;
+    len >>= 2;
+
+    /* Main loop */
+    for (; len > 0; len--) {
+        hash += get16bits(data);
+        tmp = (get16bits(data + 2) << 11) ^ hash;
+        hash = (hash << 16) ^ tmp;
+        data += 2 * sizeof(uint16_t);
+        hash += hash >> 11;
+    }
+
+    /* Handle end cases */
+    switch (rem) {
+    case 3:
+        hash += get16bits(data);
+        hash ^= hash << 16;
+        hash ^= ((signed char)data[sizeof(uint16_t)]) << 18;
+        hash += hash >> 11;
+        break;
+    case 2:
+        hash += get16bits(data);
+        hash ^= hash << 11;
+        hash += hash >> 17;
+        break;
+    case 1:
+        hash += (signed char)*data;
+        hash ^= hash << 10;
+        hash += hash >> 1;
+    }
+
+    /* Force "avalanching" of final 127 bits */
+    hash ^= hash << 3;
+    hash += hash >> 5;
+    hash ^= hash << 4;
+    hash += hash >> 17;
+    hash ^= hash << 25;
+    hash += hash >> 6;
+
+    return hash;
+}
+
+/* CRC32C (Castagnoli) lookup table for the software fallback, generated at start-up */
+static uint32_t crc32c_table[256];
+
+/* Compute CRC32C one byte at a time with the lookup table.
+ * @param crc The running CRC
+ * @param data The bytes to add to the CRC
+ * @param len The number of bytes
+ * @return The updated CRC
+ */
+static uint32_t crc32c_soft(uint32_t crc, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32c_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* Compute CRC32C with the SSE4.2 `crc32` instruction, eight bytes at a time.
+ * @param crc The running CRC
+ * @param data The bytes to add to the CRC
+ * @param len The number of bytes
+ * @return The updated CRC
+ */
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len) {
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), data += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = crc64;
+#endif
+    for (; len >= sizeof(uint32_t); len -= sizeof(uint32_t), data += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; len > 0; len--, data++) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+#endif
+
+/* The CRC32C implementation picked for this CPU */
+static uint32_t (*crc32c_impl)(uint32_t crc, const uint8_t *data, size_t len) = crc32c_soft;
+
+/* Build the CRC32C table and pick the fastest CRC32C implementation the CPU supports. Runs before `main`. */
+__attribute__((constructor)) static void hash_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        }
+        crc32c_table[i] = crc;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32c_sse42;
+    }
+#endif
+}
+
+/* Hash with CRC32C, using the SSE4.2 instruction when the CPU has it. CRCs are linear, so the result is scrambled before
+ * being returned so that the low and high bits used by the tables are both well mixed.
+ * @param data The bytes to hash
+ * @param len The number of bytes
+ * @return The hash of `data`
+ */
+uint32_t hash_crc32c(const uint8_t *data, size_t len) {
+    uint32_t crc = ~crc32c_impl(~0u, data, len);
+    return hash_mix64(crc ^ ((uint64_t)len << 32));
+}
+
+/* Multiply two 64 bit integers and fold the 128 bit product back down to 64 bits.
+ * @param a The first integer
+ * @param b The second integer
+ * @return The high and low halves of the product XORed together
+ */
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+/* Read 8, 4 or 1-3 bytes as an integer */
+static inline uint64_t wyr8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+static inline uint64_t wyr4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+static inline uint64_t wyr3(const uint8_t *p, size_t len) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+/* 64 bit hash in the style of wyhash (final version 4) by Wang Yi, released into the public domain.
+ * https://github.com/wangyi-fudan/wyhash
+ * @param data The bytes to hash
+ * @param len The number of bytes
+ * @param seed A seed to vary the hash with
+ * @return The 64 bit hash of `data`
+ */
+uint64_t hash_wy64(const uint8_t *data, size_t len, uint64_t seed) {
+    static const uint64_t secret[4] = {0x2D358DCCAA6C78A5ull, 0x8BB84B93962EACC9ull, 0x4B33A62ED433D4A3ull,
+                                       0x4D5A2DA51DE1AA47ull};
+    const uint8_t *p = data;
+    uint64_t a, b;
+
+    seed ^= wymix(seed ^ secret[0], secret[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t shift = (len >> 3) << 2;
+            a = (wyr4(p) << 32) | wyr4(p + shift);
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - shift);
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+
+        /* Three independent lanes for long inputs */
+
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ secret[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ secret[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+
+        for (; i > 16; i -= 16, p += 16) {
+            seed = wymix(wyr8(p) ^ secret[1], wyr8(p + 8) ^ seed);
+        }
+
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    __uint128_t product = (__uint128_t)a * b;
+    a = (uint64_t)product;
+    b = (uint64_t)(product >> 64);
+    return wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+/* 32 bit version of `hash_wy64` for use as a `hash_f`.
+ * @param data The bytes to hash
+ * @param len The number of bytes
+ * @return The hash of `data`
+ */
+uint32_t hash_wy(const uint8_t *data, size_t len) {
+    uint64_t hash = hash_wy64(data, len, 0);
+    return hash ^ (hash >> 32);
+}
+
+/* Hash a key that is a fixed-width integer (or a pair of them, like a coordinate) with a few multiplies. Keys of 4, 8 and
+ * 16 bytes are mixed directly. Other sizes fall back to `hash_wy`.
+ * @param data The key to hash
+ * @param len The size of the key in bytes
+ * @return The hash of the key
+ */
+uint32_t hash_int(const uint8_t *data, size_t len) {
+    uint64_t hash;
+
+    switch (len) {
+    case sizeof(uint32_t):
+        hash = hash_mix64(wyr4(data));
+        break;
+    case sizeof(uint64_t):
+        /* Read as two halves, since keys like coordinates are usually written as two 32 bit stores, and one 64 bit
+         * load right after them would stall waiting for both */
+        hash = hash_mix64(wyr4(data) | (wyr4(data + 4) << 32));
+        break;
+    case 2 * sizeof(uint64_t):
+        hash = wymix(wyr8(data) ^ 0x2D358DCCAA6C78A5ull, wyr8(data + 8) ^ 0x8BB84B93962EACC9ull);
+        break;
+    default:
+        return hash_wy(data, len);
+    }
+
+    return hash ^ (hash >> 32);
+}
+
+/* The hash function used by the containers when none is given. Integer-sized keys use `hash_int` and everything else
+ * uses `hash_wy`.
+ * @param data The bytes to hash
+ * @param len The number of bytes
+ * @return The hash of `data`
+ */
+uint32_t hash_default(const uint8_t *data, size_t len) { return hash_int(data, len); }
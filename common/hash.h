@@ -0,0 +1,30 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Generic hash function */
+typedef uint32_t (*hash_f)(const uint8_t *data, size_t len);
+
+uint32_t hash_default(const uint8_t *data, size_t len);
+uint32_t hash_hsieh(const uint8_t *data, size_t len);
+uint32_t hash_crc32c(const uint8_t *data, size_t len);
+uint32_t hash_wy(const uint8_t *data, size_t len);
+uint32_t hash_int(const uint8_t *data, size_t len);
+uint64_t hash_wy64(const uint8_t *data, size_t len, uint64_t seed);
+
+/* Scramble a 64 bit integer so that every output bit depends on every input bit (MurmurHash3's finalizer).
+ * @param x The integer to scramble
+ * @return The scrambled integer
+ */
+static inline uint64_t hash_mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+#endif // _HASH_H_
@@ -1,88 +1,156 @@
 #include "hashmap.h"
+#include "ctrl.h"
+#include "snapshot.h"
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* Represents the state of a hashmap pair. */
-enum pairstate {
-    ENT_EMPTY, /* Pair is empty */
-    ENT_DEL,   /* Pair used to contain an entry that was deleted */
-    ENT_OCC,   /* Pair is occupied */
-};
-
-#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8) + (uint32_t)(((const uint8_t *)(d))[0]))
-
-/* Fast hashing function taken from http://www.azillionmonkeys.com/qed/hash.html.
- * Author: Paul Hsieh
- * Licensed under LGPL2.1 license.
- * Should be way better than anything I can make.
- */
-static uint32_t fasthash(const uint8_t *data, size_t len) {
-    uint32_t hash = len, tmp;
-    int rem;
-
-    if (len <= 0 || data == NULL) return 0;
-
-    rem = len & 3;
-    len >>= 2;
-
-    /* Main loop */
-    for (; len > 0; len--) {
-        hash += get16bits(data);
-        tmp = (get16bits(data + 2) << 11) ^ hash;
-        hash = (hash << 16) ^ tmp;
-        data += 2 * sizeof(uint16_t);
-        hash += hash >> 11;
-    }
-
-    /* Handle end cases */
-    switch (rem) {
-    case 3:
-        hash += get16bits(data);
-        hash ^= hash << 16;
-        hash ^= ((signed char)data[sizeof(uint16_t)]) << 18;
-        hash += hash >> 11;
-        break;
-    case 2:
-        hash += get16bits(data);
-        hash ^= hash << 11;
-        hash += hash >> 17;
-        break;
-    case 1:
-        hash += (signed char)*data;
-        hash ^= hash << 10;
-        hash += hash >> 1;
-    }
-
-    /* Force "avalanching" of final 127 bits */
-    hash ^= hash << 3;
-    hash += hash >> 5;
-    hash ^= hash << 4;
-    hash += hash >> 17;
-    hash ^= hash << 25;
-    hash += hash >> 6;
-
-    return hash;
+/* Smallest capacity a hashmap's backing array will have */
+#define MIN_CAPACITY GROUP_WIDTH
+
+/* Number of keys that batched lookups hash and prefetch before probing for any of them */
+#define BATCH_LEN 16
+
+/* Calculate how many occupied or deleted pairs can live in a backing array before it must be rehashed.
+ * @param capacity The capacity of the backing array
+ * @param max_load The maximum load factor of the backing array
+ * @return The number of pairs that can be used, always leaving at least one empty pair to terminate probing
+ */
+static size_t load_limit(size_t capacity, float max_load) {
+    size_t limit = (double)capacity * max_load;
+    if (limit >= capacity) limit = capacity - 1;
+    return limit;
+}
+
+/* Calculate the capacity required to store `n` pairs without exceeding the maximum load factor.
+ * @param n The number of pairs to store
+ * @param max_load The maximum load factor of the backing array
+ * @return The smallest power of two capacity that can fit `n` pairs
+ */
+static size_t capacity_for(size_t n, float max_load) {
+    size_t capacity = MIN_CAPACITY;
+    while (load_limit(capacity, max_load) < n) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/* Get the alignment that a value of `size` bytes can safely be stored at. A type's alignment always divides its size.
+ * @param size The size of the value in bytes
+ * @return The largest power of two dividing `size`, up to 16
+ */
+static size_t natural_align(size_t size) {
+    size_t align = 1;
+    while (align < 16 && size % (align * 2) == 0) {
+        align *= 2;
+    }
+    return align;
+}
+
+/* Round `n` up to a multiple of `align`.
+ * @param n The number to round
+ * @param align The power of two alignment to round to
+ * @return `n` rounded up to a multiple of `align`
+ */
+static size_t align_up(size_t n, size_t align) { return (n + align - 1) & ~(align - 1); }
+
+/* Get the size of one slot of the backing array: a whole pair, or an index into the dense array of pairs.
+ * @param hmap The hashmap whose layout to use
+ * @return The size of a slot in bytes
+ */
+static size_t slot_size(hmap_t const *hmap) { return hmap->dense ? sizeof(uint32_t) : hmap->stride; }
+
+/* Allocate a backing array of `capacity` slots with all slots marked empty.
+ * @param hmap The hashmap whose layout to use
+ * @param capacity The number of slots
+ * @param ctrl Where to store the control byte array
+ * @param slots Where to store the slot array
+ * @return 0 on success, ENOMEM if the arrays could not be allocated, in which case both are set to NULL
+ */
+static int alloc_slots(hmap_t const *hmap, size_t capacity, uint8_t **ctrl, void **slots) {
+    *ctrl = ctrl_alloc(capacity);
+    *slots = malloc(capacity * slot_size(hmap));
+    if (*ctrl == NULL || *slots == NULL) {
+        free(*ctrl);
+        free(*slots);
+        *ctrl = NULL;
+        *slots = NULL;
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/* Update the runtime counters after the number of pairs or the capacity of the hashmap changed.
+ * @param hmap The hashmap that changed
+ */
+static void record_occupancy(hmap_t const *hmap) {
+    STATS_OCCUPANCY(hmap, hmap->len, hmap->capacity,
+                    hmap->capacity * (sizeof(uint8_t) + slot_size(hmap)) + hmap->entries_cap * hmap->stride);
+}
+
+/* Free a backing array, or unmap the snapshot file it lives in.
+ * @param hmap The hashmap the backing array belonged to
+ * @param ctrl The control byte array
+ * @param slots The slot array
+ */
+static void free_slots(hmap_t *hmap, uint8_t *ctrl, void *slots) {
+    if (hmap->map != NULL) {
+        snapshot_unmap(hmap->map, hmap->maplen);
+        hmap->map = NULL;
+        return;
+    }
+    free(ctrl);
+    free(slots);
+}
+
+/* Work out where keys and values go within a slot, keeping both naturally aligned.
+ * @param hmap The hashmap whose key and value sizes are set
+ */
+static void lay_out_slots(hmap_t *hmap) {
+    size_t valalign = natural_align(hmap->valsize);
+    size_t keyalign = natural_align(hmap->keysize);
+    hmap->valoff = align_up(hmap->keysize, valalign);
+    hmap->stride = align_up(hmap->valoff + hmap->valsize, keyalign > valalign ? keyalign : valalign);
 }
 
 /* Create a new hashmap
  * @param hmap The hashmap to initialize.
- * @param hasher The hash function to use to hash keys. Leave NULL to use default fast hash by Paul Hsieh.
- * @param init_cap The initial capacity of the backing array
+ * @param hasher The hash function to use to hash keys. Leave NULL to use `hash_default`.
+ * @param init_cap The number of pairs to reserve space for. The hashmap grows past this as needed.
  * @param keysize The size of the keys in bytes
  * @param valsize The size of the values in bytes
+ * @return 0 on success, ENOMEM if the backing array could not be allocated. The hashmap is then empty with no capacity,
+ * but can still be destroyed.
  */
-void hmap_create(hmap_t *hmap, hash_f hasher, size_t init_cap, size_t keysize, size_t valsize) {
+int hmap_create(hmap_t *hmap, hash_f hasher, size_t init_cap, size_t keysize, size_t valsize) {
     hmap->len = 0;
+    hmap->tombs = 0;
     hmap->hasher = hasher;
     if (hasher == NULL) {
-        hmap->hasher = fasthash;
+        hmap->hasher = hash_default;
     }
-    hmap->capacity = init_cap;
+    hmap->max_load = HMAP_DEFAULT_MAX_LOAD;
+    hmap->probing = HMAP_GROUP;
+    hmap->capacity = capacity_for(init_cap, hmap->max_load);
+    hmap->limit = load_limit(hmap->capacity, hmap->max_load);
     hmap->keysize = keysize;
     hmap->valsize = valsize;
-    hmap->pairs = malloc(sizeof(struct hpair) * init_cap);
-    memset(hmap->pairs, 0, sizeof(struct hpair) * init_cap); /* Mark all slots empty */
+    hmap->map = NULL;
+    hmap->dense = 0;
+    hmap->entries = NULL;
+    hmap->entries_cap = 0;
+    lay_out_slots(hmap);
+
+    int err = alloc_slots(hmap, hmap->capacity, &hmap->ctrl, &hmap->slots);
+    if (err) {
+        hmap->capacity = 0;
+        hmap->limit = 0;
+    }
+
+    STATS_REGISTER(hmap, "hmap");
+    record_occupancy(hmap);
+    return err;
 }
 
 /* Get the length of the hashmap (in key, value pairs)
@@ -91,105 +159,400 @@ void hmap_create(hmap_t *hmap, hash_f hasher, size_t init_cap, size_t keysize, s
  */
 size_t hmap_len(hmap_t const *hmap) { return hmap->len; };
 
-/* Call the hashmap hash function but ensure that computed hashes stay within the capacity of the hash map.
- * @param hmap The hashmap to use
- * @param key The key to hash
- * @return The hash of the key, guaranteed to be within the capacity of the backing array
+/* Get slot `i` of the backing array.
+ * @param hmap The hashmap to index into
+ * @param i The slot's index
+ * @return A pointer to the start of the slot
  */
-static size_t hash(const hmap_t *hmap, const void *key) { return hmap->hasher(key, hmap->keysize) % hmap->capacity; }
+static void *slot_ptr(hmap_t const *hmap, size_t i) { return (uint8_t *)hmap->slots + i * slot_size(hmap); }
 
-/* Free a hashmap pair entry.
- * @param pair The pair to free.
+/* Get the pair at index `e` of the dense array.
+ * @param hmap The dense hashmap to index into
+ * @param e The pair's index in insertion order
+ * @return A pointer to the key of the pair
  */
-static void free_pair(struct hpair *pair) {
-    /* No dangling pointer for keys */
-    free(pair->key);
-    pair->key = NULL;
+static void *entry(hmap_t const *hmap, size_t e) { return (uint8_t *)hmap->entries + e * hmap->stride; }
 
-    /* No dangling pointer for values */
-    free(pair->value);
-    pair->value = NULL;
+/* Get the key stored in slot `i`.
+ * @param hmap The hashmap to index into
+ * @param i The slot's index
+ * @return A pointer to the key inside the slot, or inside the dense array if the slot holds an index
+ */
+static void *slot_key(hmap_t const *hmap, size_t i) {
+    if (hmap->dense) return entry(hmap, *(uint32_t *)slot_ptr(hmap, i));
+    return slot_ptr(hmap, i);
 }
 
-/* Check the state of a hashmap entry.
- * @param entry The entry to check
- * @return The state of the hashmap entry
+/* Get the value stored in slot `i`.
+ * @param hmap The hashmap to index into
+ * @param i The slot's index
+ * @return A pointer to the value inside the slot, or inside the dense array if the slot holds an index
  */
-static enum pairstate entry_state(struct hpair *pair) {
-    if (pair->key == NULL && pair->value == NULL) {
-        return ENT_EMPTY;
-    }
-    if (pair->key == NULL && pair->value == (void *)-1) {
-        return ENT_DEL;
-    }
-    return ENT_OCC;
-}
+static void *slot_val(hmap_t const *hmap, size_t i) { return (uint8_t *)slot_key(hmap, i) + hmap->valoff; }
 
-/* Marks a hashmap pair as deleted.
- * @param pair The pair to mark as deleted
+/* Find the next pair to iterate over.
+ * @param hmap The hashmap to iterate over
+ * @param i Contains state between calls. Pass with initial value of 0.
+ * @return A pointer to the key of the next pair, or NULL when all pairs have been iterated over
  */
-static void mark_deleted(struct hpair *pair) {
-    pair->key = NULL;
-    pair->value = (void *)-1;
+static void *iter_next(hmap_t const *hmap, size_t *i) {
+
+    /* Dense hashmaps just walk the dense array, in insertion order */
+
+    if (hmap->dense) {
+        if (*i >= hmap->len) return NULL;
+        return entry(hmap, (*i)++);
+    }
+
+    for (; *i < hmap->capacity; (*i)++) {
+        if (ctrl_full(hmap->ctrl[*i])) {
+            return slot_key(hmap, (*i)++);
+        }
+    }
+    return NULL;
 }
 
 /* Destroy a hashmap
  * @param hmap The hash map to destroy
  */
 void hmap_destroy(hmap_t *hmap) {
+#ifdef CONTAINER_STATS
+    struct probe_stats final;
+    hmap_probe_stats(hmap, &final);
+    stats_destroyed(hmap->stats, &final);
+#endif
+
+    /* No dangling pointers for the backing array */
+    free_slots(hmap, hmap->ctrl, hmap->slots);
+    hmap->ctrl = NULL;
+    hmap->slots = NULL;
+    free(hmap->entries);
+    hmap->entries = NULL;
+}
 
-    /* Free all pairs */
-    for (size_t i = 0; i < hmap->capacity; i++) {
-        free_pair(&hmap->pairs[i]);
+/* Probe the backing array for `key`, one group of control bytes at a time.
+ * @param hmap The hashmap to search
+ * @param key The key to look for
+ * @param hash The hash of `key`
+ * @param slot Where to store the index of the matching pair, or the first free pair on the probe sequence if the key
+ * does not exist
+ * @param probes Where to store the number of groups visited
+ * @return 1 if the key was found, 0 otherwise
+ */
+static int group_probe(hmap_t const *hmap, void const *key, uint32_t hash, size_t *slot, size_t *probes) {
+    struct probeseq seq = probeseq_start(hash, hmap->capacity);
+    int have_free = 0;
+
+    /* The load limit guarantees at least one empty pair, so this always terminates before visiting every group */
+
+    for (size_t n = 0; n <= seq.mask; n++, probeseq_next(&seq)) {
+        size_t offset = probeseq_offset(&seq);
+        const uint8_t *ctrl = hmap->ctrl + offset;
+        *probes = n + 1;
+
+        /* Only compare the keys of slots whose control byte matches the key's hash */
+
+        groupmask_t match = group_match(ctrl, H2(hash));
+        while (match) {
+            size_t i = offset + group_next(&match);
+            if (!memcmp(slot_key(hmap, i), key, hmap->keysize)) {
+                *slot = i;
+                return 1;
+            }
+        }
+
+        /* Remember the first free pair to insert into, preferring to re-use deleted pairs */
+
+        if (!have_free) {
+            groupmask_t free = group_match_free(ctrl);
+            if (free) {
+                *slot = offset + group_next(&free);
+                have_free = 1;
+            }
+        }
+
+        /* Nothing ever lived in part of this group, so the key can't be further along */
+
+        if (group_match_empty(ctrl)) {
+            return 0;
+        }
     }
 
-    /* No dangling pointer for pairs */
-    free(hmap->pairs);
-    hmap->pairs = NULL;
+    return 0;
 }
 
-/* Get the value corresponding with `key` if it exists.
+/* Get how far the pair in slot `i` of a Robin Hood table is from its home slot.
+ * @param hmap The hashmap to check
+ * @param i The index of a full slot
+ * @return The distance of the pair from its home slot
+ */
+static size_t rh_dist(hmap_t const *hmap, size_t i) {
+    if (hmap->ctrl[i] < RH_MAX_DIST) return hmap->ctrl[i];
+    return (i - rh_home(hmap->hasher(slot_key(hmap, i), hmap->keysize), hmap->capacity)) & (hmap->capacity - 1);
+}
+
+/* Linearly probe a Robin Hood table for `key`. Pairs along a run are ordered by their home slot, so the search can stop
+ * as soon as it reaches a pair that is closer to its home than `key` would be.
  * @param hmap The hashmap to search
  * @param key The key to look for
- * @return A reference to the value associated with `key`, or NULL if the key does not exist.
+ * @param hash The hash of `key`
+ * @param slot Where to store the index of the matching pair, or the slot the key should be inserted at if it does not
+ * exist
+ * @param probes Where to store the number of slots visited
+ * @return 1 if the key was found, 0 otherwise
  */
-void *hmap_get(hmap_t const *hmap, void const *key) {
-    size_t index = hash(hmap, key);
-    size_t i = index;
+static int rh_probe(hmap_t const *hmap, void const *key, uint32_t hash, size_t *slot, size_t *probes) {
+    size_t mask = hmap->capacity - 1;
+    size_t i = rh_home(hash, hmap->capacity);
 
-    do {
-        switch (entry_state(&hmap->pairs[i])) {
+    /* Visit every slot at most once in case the hashmap is full */
 
-        /* Nothing ever lived here, so key doesn't exist */
-        case ENT_EMPTY:
-            return NULL;
+    for (size_t dist = 0; dist < hmap->capacity; dist++, i = (i + 1) & mask) {
+        *probes = dist + 1;
+        if (hmap->ctrl[i] == CTRL_EMPTY) break;
 
-        /* Something used to live here, keep probing */
-        case ENT_DEL: {
-            break;
+        size_t cur = rh_dist(hmap, i);
+        if (cur < dist) break;
+        if (cur == dist && !memcmp(slot_key(hmap, i), key, hmap->keysize)) {
+            *slot = i;
+            return 1;
         }
+    }
 
-        /* Something lives here */
-        case ENT_OCC: {
+    *slot = i;
+    return 0;
+}
 
-            /* Key matches, this is the value we need */
-            if (!memcmp(hmap->pairs[i].key, key, hmap->keysize)) {
-                return hmap->pairs[i].value;
-            }
+/* Probe the backing array for `key` with the hashmap's probing scheme.
+ * @param hmap The hashmap to search
+ * @param key The key to look for
+ * @param hash The hash of `key`
+ * @param slot Where to store the index of the matching pair, or where the key should be inserted if it does not exist
+ * @param probes Where to store the length of the probe sequence that was walked
+ * @return 1 if the key was found, 0 otherwise
+ */
+static int probe(hmap_t const *hmap, void const *key, uint32_t hash, size_t *slot, size_t *probes) {
+    if (hmap->probing == HMAP_ROBIN) {
+        return rh_probe(hmap, key, hash, slot, probes);
+    }
+    return group_probe(hmap, key, hash, slot, probes);
+}
+
+/* Probe the backing array for `key` on behalf of the user, counting the probe sequence in the runtime counters.
+ * @param hmap The hashmap to search
+ * @param key The key to look for
+ * @param hash The hash of `key`
+ * @param slot Where to store the index of the matching pair, or where the key should be inserted if it does not exist
+ * @return 1 if the key was found, 0 otherwise
+ */
+static int lookup(hmap_t const *hmap, void const *key, uint32_t hash, size_t *slot) {
+    size_t probes = 0;
+    int found = probe(hmap, key, hash, slot, &probes);
+    STATS_PROBE(hmap, probes);
+    return found;
+}
+
+/* Prepare slot `i` to receive a new pair. In a Robin Hood table, the run of pairs starting at `i` is shifted forward by
+ * one slot to make room.
+ * @param hmap The hashmap to insert into
+ * @param i The slot returned by `probe` for the new key
+ * @param hash The hash of the new key
+ */
+static void claim(hmap_t *hmap, size_t i, uint32_t hash) {
+    size_t mask = hmap->capacity - 1;
+
+    if (hmap->probing == HMAP_GROUP) {
+        if (hmap->ctrl[i] == CTRL_DEL) hmap->tombs--;
+        hmap->ctrl[i] = H2(hash);
+        return;
+    }
+
+    /* Find the end of the run, then move each pair one slot further from its home */
+
+    size_t end = i;
+    while (hmap->ctrl[end] != CTRL_EMPTY) {
+        end = (end + 1) & mask;
+    }
+
+    for (size_t j = end; j != i; j = (j - 1) & mask) {
+        size_t prev = (j - 1) & mask;
+        memcpy(slot_ptr(hmap, j), slot_ptr(hmap, prev), slot_size(hmap));
+        hmap->ctrl[j] = rh_ctrl(hmap->ctrl[prev] + 1);
+    }
+
+    hmap->ctrl[i] = rh_ctrl((i - rh_home(hash, hmap->capacity)) & mask);
+}
 
-            /* No match, keep probing */
-            break;
+/* Remove the pair in slot `i`.
+ * @param hmap The hashmap to remove from
+ * @param i The index of a full slot
+ */
+static void release(hmap_t *hmap, size_t i) {
+    size_t mask = hmap->capacity - 1;
+
+    /* Probing stops at the first group with an empty slot, so if this group already has one, no probe sequence passes
+     * through it and the slot can be marked empty. Otherwise it must be marked as deleted. */
+
+    if (hmap->probing == HMAP_GROUP) {
+        if (group_match_empty(hmap->ctrl + i / GROUP_WIDTH * GROUP_WIDTH)) {
+            hmap->ctrl[i] = CTRL_EMPTY;
+        } else {
+            hmap->ctrl[i] = CTRL_DEL;
+            hmap->tombs++;
         }
+        return;
+    }
+
+    /* Robin Hood tables shift the rest of the run back by one slot, so nothing is left behind */
+
+    size_t next = (i + 1) & mask;
+    while (hmap->ctrl[next] != CTRL_EMPTY) {
+        size_t dist = rh_dist(hmap, next);
+        if (dist == 0) break; /* Already home, the run ends here */
+
+        memcpy(slot_ptr(hmap, i), slot_ptr(hmap, next), slot_size(hmap));
+        hmap->ctrl[i] = rh_ctrl(dist - 1);
+        i = next;
+        next = (next + 1) & mask;
+    }
+    hmap->ctrl[i] = CTRL_EMPTY;
+}
+
+/* Move all pairs into a new backing array, dropping any deleted pairs. If the hashmap has a dense array of pairs, the
+ * pairs are taken from it instead of the old backing array, and only their indices are stored if it is still dense.
+ * @param hmap The hashmap to rehash
+ * @param capacity The capacity of the new backing array, must be a power of two large enough for all pairs
+ * @return 0 on success, ENOMEM if the new backing array could not be allocated
+ */
+static int rehash(hmap_t *hmap, size_t capacity) {
+    uint8_t *old_ctrl = hmap->ctrl;
+    void *old_slots = hmap->slots;
+    size_t old_cap = hmap->capacity;
+
+    if (alloc_slots(hmap, capacity, &hmap->ctrl, &hmap->slots)) {
+        hmap->ctrl = old_ctrl;
+        hmap->slots = old_slots;
+        return ENOMEM;
+    }
+
+    hmap->capacity = capacity;
+    hmap->limit = load_limit(capacity, hmap->max_load);
+    hmap->tombs = 0;
+
+    /* Keys are unique, so probing only finds the slot to insert each pair into */
+
+    size_t n = hmap->entries != NULL ? hmap->len : old_cap;
+    for (size_t i = 0; i < n; i++) {
+        void *pair;
+        if (hmap->entries != NULL) {
+            pair = entry(hmap, i);
+        } else if (ctrl_full(old_ctrl[i])) {
+            pair = (uint8_t *)old_slots + i * hmap->stride;
+        } else {
+            continue;
         }
 
-        /* Probe whole backing array in a circular loop */
+        uint32_t hash = hmap->hasher(pair, hmap->keysize);
+        size_t j, probes;
+        probe(hmap, pair, hash, &j, &probes);
+        claim(hmap, j, hash);
+        if (hmap->dense) {
+            *(uint32_t *)slot_ptr(hmap, j) = i;
+        } else {
+            memcpy(slot_ptr(hmap, j), pair, hmap->stride);
+        }
+    }
 
-        i = (i + 1) % hmap->capacity;
+    free_slots(hmap, old_ctrl, old_slots);
+    STATS_REHASH(hmap);
+    record_occupancy(hmap);
+    return 0;
+}
 
-    } while (i != index);
+/* Get the first slot that a probe for `hash` looks at: the start of its first group, or its home slot in a Robin Hood
+ * table.
+ * @param hmap The hashmap to probe
+ * @param hash The hash of the key being probed for
+ * @return The index of the slot
+ */
+static size_t first_slot(hmap_t const *hmap, uint32_t hash) {
+    if (hmap->probing == HMAP_ROBIN) {
+        return rh_home(hash, hmap->capacity);
+    }
+    struct probeseq seq = probeseq_start(hash, hmap->capacity);
+    return probeseq_offset(&seq);
+}
 
-    /* Loop completed but empty-handed */
-    return NULL;
+/* Start loading the pair that a probe for `hash` will most likely compare against. Grouped tables check the group's
+ * control bytes for a candidate first, so those should already have been prefetched.
+ * @param hmap The hashmap to probe
+ * @param hash The hash of the key being probed for
+ */
+static void prefetch_pair(hmap_t const *hmap, uint32_t hash) {
+    size_t i = first_slot(hmap, hash);
+    if (hmap->probing == HMAP_GROUP) {
+        groupmask_t match = group_match(hmap->ctrl + i, H2(hash));
+        if (!match) return;
+        i += group_next(&match);
+    }
+    __builtin_prefetch(slot_ptr(hmap, i));
+}
+
+/* Get the value corresponding with `key` if it exists.
+ * @param hmap The hashmap to search
+ * @param key The key to look for
+ * @return A reference to the value associated with `key`, or NULL if the key does not exist. The reference is valid
+ * until the next insertion of a new key, removal or rehash.
+ */
+void *hmap_get(hmap_t const *hmap, void const *key) {
+    size_t i;
+    if (!lookup(hmap, key, hmap->hasher(key, hmap->keysize), &i)) {
+        return NULL;
+    }
+    return slot_val(hmap, i);
+}
+
+/* Look up many keys at once. Each block of keys is hashed and its control bytes and pairs are prefetched before any
+ * of it is probed, so the cache misses of independent lookups overlap instead of happening one after another.
+ * @param hmap The hashmap to search
+ * @param keys A contiguous array of `n` keys
+ * @param n The number of keys to look up
+ * @param vals Where to store a reference to the value of each key, or NULL for keys that do not exist. The references
+ * are valid until the next insertion of a new key, removal or rehash.
+ * @return The number of keys that were found
+ */
+size_t hmap_get_batch(hmap_t const *hmap, void const *keys, size_t n, void **vals) {
+    uint32_t hashes[BATCH_LEN];
+    size_t found = 0;
+
+    for (size_t start = 0; start < n; start += BATCH_LEN) {
+        size_t len = n - start < BATCH_LEN ? n - start : BATCH_LEN;
+        const uint8_t *block = (const uint8_t *)keys + start * hmap->keysize;
+
+        /* Hash the whole block, requesting the control bytes each key will be probed at */
+
+        for (size_t i = 0; i < len; i++) {
+            hashes[i] = hmap->hasher(block + i * hmap->keysize, hmap->keysize);
+            __builtin_prefetch(hmap->ctrl + first_slot(hmap, hashes[i]));
+        }
+
+        /* By now the control bytes are arriving, so request the pairs they point at */
+
+        for (size_t i = 0; i < len; i++) {
+            prefetch_pair(hmap, hashes[i]);
+        }
+
+        for (size_t i = 0; i < len; i++) {
+            size_t slot;
+            vals[start + i] = NULL;
+            if (lookup(hmap, block + i * hmap->keysize, hashes[i], &slot)) {
+                vals[start + i] = slot_val(hmap, slot);
+                found++;
+            }
+        }
+    }
+
+    return found;
 }
 
 /* Remove an entry from the hashmap
@@ -197,134 +560,418 @@ void *hmap_get(hmap_t const *hmap, void const *key) {
  * @param key The key to the pair to remove
  */
 void hmap_remove(hmap_t *hmap, void const *key) {
+    size_t i;
 
-    size_t index = hash(hmap, key);
-    size_t i = index;
+    /* Key never existed, nothing to remove */
 
-    /* Check the state of the entry, probing until the key is found or we can confirm it never existed */
+    if (!lookup(hmap, key, hmap->hasher(key, hmap->keysize), &i)) {
+        return;
+    }
 
-    do {
+    size_t e = hmap->dense ? *(uint32_t *)slot_ptr(hmap, i) : 0;
+    release(hmap, i);
+    hmap->len--;
 
-        switch (entry_state(&hmap->pairs[i])) {
+    /* Keep the dense array dense by moving its last pair into the hole, and pointing that pair's slot at its new
+     * index */
 
-        /* Entry is empty, nothing ever lived here, nothing to remove any further */
-        case ENT_EMPTY:
-            return;
+    if (hmap->dense && e != hmap->len) {
+        void *last = entry(hmap, hmap->len);
+        size_t j, probes;
+        probe(hmap, last, hmap->hasher(last, hmap->keysize), &j, &probes);
+        *(uint32_t *)slot_ptr(hmap, j) = e;
+        memcpy(entry(hmap, e), last, hmap->stride);
+    }
+    record_occupancy(hmap);
+}
 
-        /* If the entry is occupied, check for key equality */
-        case ENT_OCC: {
+/* Get the value slot for `key`, creating a zero-initialized pair if the key does not exist yet. Only one probe
+ * sequence is walked either way.
+ * @param hmap The hashmap to update
+ * @param key The key to look up or insert
+ * @param inserted Set to 1 if a new pair was created, 0 if the key already existed. Pass NULL to ignore.
+ * @return A reference to the key's value, or NULL if there was not enough memory to store a new pair. The reference is
+ * valid until the next insertion of a new key, removal or rehash.
+ */
+void *hmap_entry(hmap_t *hmap, void const *key, int *inserted) {
+    uint32_t hash = hmap->hasher(key, hmap->keysize);
+    size_t i;
 
-            /* We found a matching entry, remove the pair and mark as deleted */
-            if (!memcmp(hmap->pairs[i].key, key, hmap->keysize)) {
-                free_pair(&hmap->pairs[i]);
-                mark_deleted(&hmap->pairs[i]);
-                hmap->len--;
-                return;
-            }
+    if (inserted != NULL) *inserted = 0;
 
-            /* Keys not equal, continue probing */
-            break;
-        }
+    /* Key already exists, hand back its value */
 
-        /* Entry was deleted, continue probing */
-        case ENT_DEL: {
-            break;
-        }
-        }
+    if (lookup(hmap, key, hash, &i)) {
+        return slot_val(hmap, i);
+    }
 
-        i = (i + 1) % hmap->capacity; /* Probe whole backing array in circular loop */
+    /* Using up an empty pair might exceed the load limit. Grow if there are many live pairs, otherwise just rehash in
+     * place to clear out the deleted pairs. Robin Hood insertions always use up an empty pair at the end of the run. */
 
-    } while (i != index);
+    if ((hmap->probing == HMAP_ROBIN || hmap->ctrl[i] == CTRL_EMPTY) && hmap->len + hmap->tombs + 1 > hmap->limit) {
+        size_t capacity = (hmap->len + 1) * 2 > hmap->limit ? hmap->capacity * 2 : hmap->capacity;
+        if (rehash(hmap, capacity)) return NULL;
+
+        size_t probes;
+        probe(hmap, key, hash, &i, &probes);
+    }
+
+    /* Dense hashmaps append the pair to the dense array, which may need to grow first */
+
+    if (hmap->dense && hmap->len == hmap->entries_cap) {
+        size_t entries_cap = hmap->entries_cap ? hmap->entries_cap * 2 : MIN_CAPACITY;
+        void *entries = realloc(hmap->entries, entries_cap * hmap->stride);
+        if (entries == NULL) return NULL;
+        hmap->entries = entries;
+        hmap->entries_cap = entries_cap;
+    }
+
+    /* Store the key with a zeroed value */
+
+    claim(hmap, i, hash);
+    if (hmap->dense) *(uint32_t *)slot_ptr(hmap, i) = hmap->len;
+    memcpy(slot_key(hmap, i), key, hmap->keysize);
+    memset(slot_val(hmap, i), 0, hmap->valsize);
+    hmap->len++;
+    record_occupancy(hmap);
+
+    if (inserted != NULL) *inserted = 1;
+    return slot_val(hmap, i);
 }
 
-/* Add or update a pair in the hashmap.
+/* Add or update a pair in the hashmap. The backing array grows once the maximum load factor is reached.
  * @param hmap The hashmap to update
  * @param key The key to use for the pair
  * @param value The value to use for the pair
+ * @return 0 on success, ENOMEM if there was not enough memory to store the pair
  */
-void hmap_put(hmap_t *hmap, void const *key, void const *value) {
-    size_t index = hash(hmap, key);
-    size_t i = index;
+int hmap_put(hmap_t *hmap, void const *key, void const *value) {
+    void *slot = hmap_entry(hmap, key, NULL);
+    if (slot == NULL) {
+        return ENOMEM;
+    }
+    memcpy(slot, value, hmap->valsize);
+    return 0;
+}
 
-    // TODO: handle allocating more space if there is not enough
+/* Add to the counter associated with `key`, starting it at zero if it does not exist yet. The hashmap's values must be
+ * `uint64_t`.
+ * @param hmap The hashmap of counters
+ * @param key The key whose counter to increase
+ * @param delta The amount to increase the counter by
+ * @return 0 on success, ENOMEM if there was not enough memory to store a new counter
+ */
+int hmap_add_u64(hmap_t *hmap, void const *key, uint64_t delta) {
+    uint64_t *count = hmap_entry(hmap, key, NULL);
+    if (count == NULL) {
+        return ENOMEM;
+    }
+    *count += delta;
+    return 0;
+}
 
-    do {
-        /* Check entry state */
-        switch (entry_state(&hmap->pairs[i])) {
+/* Remove every pair from the hashmap, keeping its backing array for reuse. Only the control bytes are reset, which
+ * is one byte per slot and no allocation.
+ * @param hmap The hashmap to clear
+ */
+void hmap_clear(hmap_t *hmap) {
+    if (hmap->len == 0 && hmap->tombs == 0) return;
 
-        /* If the slot is free */
-        case ENT_EMPTY:
-        case ENT_DEL:
+    memset(hmap->ctrl, CTRL_EMPTY, hmap->capacity);
+    hmap->len = 0;
+    hmap->tombs = 0;
+    record_occupancy(hmap);
+}
 
-            /* Store key, value pair */
-            hmap->pairs[i].key = malloc(hmap->keysize);
-            memcpy(hmap->pairs[i].key, key, hmap->keysize);
-            hmap->pairs[i].value = malloc(hmap->valsize);
-            memcpy(hmap->pairs[i].value, value, hmap->valsize);
-            hmap->len++;
-            return;
+/* Ensure the hashmap can hold at least `n` pairs without needing to grow.
+ * @param hmap The hashmap to reserve space in
+ * @param n The number of pairs to make space for
+ * @return 0 on success, ENOMEM if the backing array could not be grown
+ */
+int hmap_reserve(hmap_t *hmap, size_t n) {
+    size_t capacity = capacity_for(n, hmap->max_load);
+    if (capacity <= hmap->capacity) return 0;
+    return rehash(hmap, capacity);
+}
 
-        /* If the slot is occupied */
-        case ENT_OCC:
+/* Shrink the backing array to the smallest capacity that holds the current pairs.
+ * @param hmap The hashmap to shrink
+ * @return 0 on success, ENOMEM if the new backing array could not be allocated
+ */
+int hmap_shrink_to_fit(hmap_t *hmap) {
 
-            /* Check if the key matches what's in this slot, and if so replace it. */
-            if (!memcmp(hmap->pairs[i].key, key, hmap->keysize)) {
-                memcpy(hmap->pairs[i].value, value, hmap->valsize);
-                return;
-            }
+    /* The dense array can be trimmed in place */
+
+    if (hmap->dense && hmap->entries_cap > hmap->len && hmap->len > 0) {
+        void *entries = realloc(hmap->entries, hmap->len * hmap->stride);
+        if (entries == NULL) return ENOMEM;
+        hmap->entries = entries;
+        hmap->entries_cap = hmap->len;
+    }
 
-            i = (i + 1) % hmap->capacity; /* Linearly probe until an available slot is found */
-            break;
+    size_t capacity = capacity_for(hmap->len, hmap->max_load);
+    if (capacity == hmap->capacity && hmap->tombs == 0) return 0;
+    return rehash(hmap, capacity);
+}
+
+/* Set the maximum load factor of the hashmap, rehashing if the current pairs no longer fit.
+ * @param hmap The hashmap to configure
+ * @param max_load The fraction of the backing array that may be used before it grows, in the range (0, 1]
+ * @return 0 on success, EINVAL if `max_load` is out of range, ENOMEM if a required rehash failed
+ */
+int hmap_set_max_load(hmap_t *hmap, float max_load) {
+    if (!(max_load > 0.0f && max_load <= 1.0f)) {
+        return EINVAL;
+    }
+
+    hmap->max_load = max_load;
+    hmap->limit = load_limit(hmap->capacity, max_load);
+    if (hmap->len + hmap->tombs > hmap->limit) {
+        return rehash(hmap, capacity_for(hmap->len, max_load));
+    }
+    return 0;
+}
+
+/* Change the probing scheme of the hashmap, rehashing the existing pairs into the new scheme.
+ * @param hmap The hashmap to configure
+ * @param probing The probing scheme to use
+ * @return 0 on success, ENOMEM if the rehash failed
+ */
+int hmap_set_probing(hmap_t *hmap, enum hmap_probe_e probing) {
+    if (hmap->probing == probing) return 0;
+
+    enum hmap_probe_e old = hmap->probing;
+    hmap->probing = probing;
+    int err = rehash(hmap, hmap->capacity);
+    if (err) hmap->probing = old;
+    return err;
+}
+
+/* Switch the hashmap between storing pairs in its slots, and storing them in a separate dense array with the slots
+ * only holding indices into it. Dense hashmaps iterate over just their pairs, contiguously and in insertion order,
+ * instead of scanning every slot, at the cost of one extra indirection per lookup.
+ * @param hmap The hashmap to configure
+ * @param dense 1 to store pairs densely, 0 to store them in the slots
+ * @return 0 on success, ENOMEM if the pairs could not be moved
+ */
+int hmap_set_dense(hmap_t *hmap, int dense) {
+    dense = dense != 0;
+    if (hmap->dense == dense) return 0;
+
+    if (dense) {
+
+        /* Gather the pairs into the dense array, then index them */
+
+        size_t entries_cap = hmap->len > MIN_CAPACITY ? hmap->len : MIN_CAPACITY;
+        void *entries = malloc(entries_cap * hmap->stride);
+        if (entries == NULL) return ENOMEM;
+
+        size_t i = 0;
+        void *pair;
+        for (size_t e = 0; (pair = iter_next(hmap, &i)) != NULL; e++) {
+            memcpy((uint8_t *)entries + e * hmap->stride, pair, hmap->stride);
+        }
+
+        hmap->entries = entries;
+        hmap->entries_cap = entries_cap;
+        hmap->dense = 1;
+        int err = rehash(hmap, hmap->capacity);
+        if (err) {
+            hmap->dense = 0;
+            free(hmap->entries);
+            hmap->entries = NULL;
+            hmap->entries_cap = 0;
         }
-    } while (i != index);
+        return err;
+    }
+
+    /* Move the pairs back into the slots */
+
+    hmap->dense = 0;
+    int err = rehash(hmap, hmap->capacity);
+    if (err) {
+        hmap->dense = 1;
+        return err;
+    }
+    free(hmap->entries);
+    hmap->entries = NULL;
+    hmap->entries_cap = 0;
+    return 0;
+}
+
+/* Measure how many probes it takes to find each pair in the hashmap.
+ * @param hmap The hashmap to measure
+ * @param stats Where to store the statistics. Probe lengths are counted in slots for Robin Hood probing and in groups
+ * of slots for grouped probing.
+ */
+void hmap_probe_stats(hmap_t const *hmap, struct probe_stats *stats) {
+    size_t sum = 0;
+    size_t sum_sq = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->tombs = hmap->tombs;
+
+    for (size_t i = 0; i < hmap->capacity; i++) {
+        if (!ctrl_full(hmap->ctrl[i])) continue;
+
+        size_t probes = 1;
+        if (hmap->probing == HMAP_ROBIN) {
+            probes += rh_dist(hmap, i);
+        } else {
+            struct probeseq seq = probeseq_start(hmap->hasher(slot_key(hmap, i), hmap->keysize), hmap->capacity);
+            for (; seq.group != i / GROUP_WIDTH; probeseq_next(&seq)) {
+                probes++;
+            }
+        }
+
+        if (probes > stats->max) stats->max = probes;
+        sum += probes;
+        sum_sq += probes * probes;
+        stats->len++;
+    }
+
+    if (stats->len == 0) return;
+    stats->mean = (double)sum / stats->len;
+    stats->variance = (double)sum_sq / stats->len - stats->mean * stats->mean;
+}
+
+/* Print how full the hashmap is and how long its probe sequences are. When built with `CONTAINER_STATS`, the runtime
+ * counters collected since the hashmap was created are printed too.
+ * @param hmap The hashmap to report on
+ * @param stream The stream to print to
+ */
+void hmap_dump_stats(hmap_t const *hmap, FILE *stream) {
+    struct probe_stats probes;
+    hmap_probe_stats(hmap, &probes);
+
+    fprintf(stream, "hmap: len %zu, capacity %zu, load %.3f (max %.3f), %zu bytes, %s probing%s\n", hmap->len,
+            hmap->capacity, hmap->capacity ? (double)hmap->len / hmap->capacity : 0.0, hmap->max_load,
+            hmap->capacity * (sizeof(uint8_t) + slot_size(hmap)) + hmap->entries_cap * hmap->stride,
+            hmap->probing == HMAP_ROBIN ? "robin hood" : "group", hmap->dense ? ", dense" : "");
+    stats_print_probes(stream, &probes);
+
+#ifdef CONTAINER_STATS
+    if (hmap->stats != NULL) stats_print(stream, hmap->stats);
+#endif
 }
 
-/* Iterate over the keys in the hashmap.
+/* Save the hashmap to a snapshot file, which `hmap_load_mmap` can map back in without rehashing. The keys and values
+ * are stored as raw bytes, so they must not hold pointers.
+ * @param hmap The hashmap to save
+ * @param path The path of the file to write, replaced if it exists
+ * @return 0 on success, ENOTSUP if the hashmap is dense, otherwise the errno of the failed file operation
+ */
+int hmap_save(hmap_t const *hmap, const char *path) {
+    if (hmap->dense) {
+        return ENOTSUP; /* Snapshots only hold tables with the pairs in their slots */
+    }
+
+    struct snapshot_header header = {
+        .kind = SNAPSHOT_HMAP,
+        .probing = hmap->probing,
+        .fingerprint = snapshot_fingerprint(hmap->hasher),
+        .max_load = hmap->max_load,
+        .capacity = hmap->capacity,
+        .len = hmap->len,
+        .tombs = hmap->tombs,
+        .keysize = hmap->keysize,
+        .valsize = hmap->valsize,
+        .stride = hmap->stride,
+        .valoff = hmap->valoff,
+    };
+    return snapshot_save(path, &header, hmap->ctrl, hmap->slots);
+}
+
+/* Create a hashmap from a snapshot file written by `hmap_save`. The file is mapped into memory rather than read, so
+ * this costs the same no matter how many pairs there are, and pages are only loaded as lookups touch them. The
+ * hashmap can be changed like any other; changes never reach the file. The mapping is released once the hashmap is
+ * destroyed or its backing array is rebuilt.
+ * @param hmap The hashmap to initialize. Left untouched on failure.
+ * @param hasher The hash function the hashmap was saved with. Leave NULL to use `hash_default`.
+ * @param keysize The size of the keys the caller expects, which the snapshot must match
+ * @param valsize The size of the values the caller expects, which the snapshot must match
+ * @param path The path of the snapshot file
+ * @return 0 on success, EINVAL if the file is not a hashmap snapshot with these key and value sizes usable with this
+ * build and `hasher`, otherwise the errno of the failed file operation
+ */
+int hmap_load_mmap(hmap_t *hmap, hash_f hasher, size_t keysize, size_t valsize, const char *path) {
+    struct snapshot_header header;
+    hmap_t loaded = {.hasher = hasher == NULL ? hash_default : hasher};
+
+    int err = snapshot_load(path, SNAPSHOT_HMAP, loaded.hasher, &header, &loaded.ctrl, &loaded.slots, &loaded.map,
+                            &loaded.maplen);
+    if (err) {
+        return err;
+    }
+
+    /* The layout of the slots must match what this build would use for the same key and value sizes */
+
+    loaded.keysize = header.keysize;
+    loaded.valsize = header.valsize;
+    lay_out_slots(&loaded);
+    if (header.keysize != keysize || header.valsize != valsize || loaded.stride != header.stride ||
+        loaded.valoff != header.valoff ||
+        (header.probing != HMAP_GROUP && header.probing != HMAP_ROBIN) ||
+        !(header.max_load > 0.0f && header.max_load <= 1.0f)) {
+        snapshot_unmap(loaded.map, loaded.maplen);
+        return EINVAL;
+    }
+
+    loaded.capacity = header.capacity;
+    loaded.len = header.len;
+    loaded.tombs = header.tombs;
+    loaded.max_load = header.max_load;
+    loaded.limit = load_limit(loaded.capacity, loaded.max_load);
+    loaded.probing = header.probing;
+
+    /* Probing relies on the load limit leaving an empty slot, so a fuller table can't be used */
+
+    if (loaded.len + loaded.tombs > loaded.limit) {
+        snapshot_unmap(loaded.map, loaded.maplen);
+        return EINVAL;
+    }
+    *hmap = loaded;
+
+    STATS_REGISTER(hmap, "hmap");
+    record_occupancy(hmap);
+    return 0;
+}
+
+/* Iterate over the keys in the hashmap. Dense hashmaps are iterated in insertion order, except that removing a pair
+ * moves the most recently inserted pair into its place.
  * @param i Contains state between calls. Pass with initial value of 0.
  * @param key Where to store the reference to the current key
  * @return NULL when all keys have been iterated over, the same pointer as `key` otherwise
  */
 void *hmap_iter_keys(hmap_t const *hmap, size_t *i, void **key) {
-    for (; *i < hmap->capacity; (*i)++) {
-        if (entry_state(&hmap->pairs[*i]) == ENT_OCC) {
-            *key = hmap->pairs[*i].key;
-            (*i)++;
-            return *key;
-        }
-    }
-    return NULL;
+    void *pair = iter_next(hmap, i);
+    if (pair == NULL) return NULL;
+    *key = pair;
+    return *key;
 }
 
-/* Iterate over the values in the hashmap.
+/* Iterate over the values in the hashmap, in the same order as `hmap_iter_keys`.
  * @param i Contains state between calls. Pass with initial value of 0.
  * @param val Where to store the reference to the current value
  * @return NULL when all values have been iterated over, the same pointer as contained in `val` otherwise
  */
 void *hmap_iter_vals(hmap_t const *hmap, size_t *i, void **val) {
-    for (; *i < hmap->capacity; (*i)++) {
-        if (entry_state(&hmap->pairs[*i]) == ENT_OCC) {
-            *val = hmap->pairs[*i].value;
-            (*i)++;
-            return *val;
-        }
-    }
-    return NULL;
+    void *pair = iter_next(hmap, i);
+    if (pair == NULL) return NULL;
+    *val = (uint8_t *)pair + hmap->valoff;
+    return *val;
 }
 
-/* Iterate over the pairs in the hash map.
+/* Iterate over the pairs in the hash map, in the same order as `hmap_iter_keys`.
  * @param i Contains state between calls. Pass with initial value of 0.
  * @param key Where to store the reference to the current key
  * @param val Where to store the reference to the current value
  * @return NULL when all values have been iterated over, the same pointer as `key` otherwise
  */
 void *hmap_iter_pairs(hmap_t const *hmap, size_t *i, void **key, void **val) {
-    for (; *i < hmap->capacity; (*i)++) {
-        if (entry_state(&hmap->pairs[*i]) == ENT_OCC) {
-            *key = hmap->pairs[*i].key;
-            *val = hmap->pairs[*i].value;
-            (*i)++;
-            return key;
-        }
-    }
-    return NULL;
+    void *pair = iter_next(hmap, i);
+    if (pair == NULL) return NULL;
+    *key = pair;
+    *val = (uint8_t *)pair + hmap->valoff;
+    return key;
 }
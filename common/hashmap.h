@@ -4,31 +4,71 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-/* Generic hash function */
-typedef uint32_t (*hash_f)(const uint8_t *data, size_t len);
+#include "hash.h"
+#include "stats.h"
 
-/* Hashmap pair */
-struct hpair {
-    void *key;   /* The pair's key */
-    void *value; /* The pair's value */
+/* Default maximum load factor before the backing array is grown */
+#define HMAP_DEFAULT_MAX_LOAD 0.875f
+
+/* Probing schemes of a hash map */
+enum hmap_probe_e {
+    HMAP_GROUP, /* Probe whole groups of control bytes at once (default) */
+    HMAP_ROBIN, /* Robin Hood linear probing with backward-shift deletion, which leaves no deleted markers behind */
 };
 
-/* A hash map. */
+/* A hash map. Keys and values are stored inline in one contiguous array of slots, with a separate control byte per slot
+ * holding 7 bits of the slot's hash so that lookups can check a whole group of slots at once.
+ * References returned by `hmap_get` and the iterators point into the slot array, so they are only valid until the next
+ * insertion of a new key, removal or rehash (`hmap_put`, `hmap_remove`, `hmap_reserve`, `hmap_shrink_to_fit`,
+ * `hmap_set_max_load`). Updating the value of an existing key does not move anything.
+ * A dense hashmap (`hmap_set_dense`) keeps its pairs in a separate array in insertion order instead, so iterating only
+ * visits live pairs.
+ * A hashmap can be saved to a snapshot file with `hmap_save` and mapped back in with `hmap_load_mmap`, as long as its
+ * keys and values hold no pointers.
+ */
 typedef struct {
-    size_t capacity;     /* Capacity of backing array in number of pairs */
-    size_t keysize;      /* Size of keys */
-    size_t valsize;      /* Size of values */
-    size_t len;          /* Number of key, value pairs stored */
-    struct hpair *pairs; /* Backing array of pairs */
-    hash_f hasher;       /* Hash function to use */
+    size_t capacity;           /* Capacity of backing array in number of pairs, always a power of two */
+    size_t keysize;            /* Size of keys */
+    size_t valsize;            /* Size of values */
+    size_t len;                /* Number of key, value pairs stored */
+    size_t tombs;              /* Number of pairs marked as deleted */
+    size_t limit;              /* Number of occupied + deleted pairs allowed before a rehash */
+    size_t valoff;             /* Offset of the value from the start of a slot */
+    size_t stride;             /* Size of a slot holding a key, value pair */
+    float max_load;            /* Maximum load factor of the backing array */
+    enum hmap_probe_e probing; /* Probing scheme */
+    uint8_t *ctrl;             /* Control byte of each slot in the backing array */
+    void *slots;               /* Backing array of inline key, value pairs */
+    hash_f hasher;             /* Hash function to use */
+    int dense;                 /* 1 if the pairs live in `entries` and the slots hold indices into it */
+    void *entries;             /* Dense array of pairs in insertion order, only used when dense */
+    size_t entries_cap;        /* Capacity of the dense array in pairs */
+    void *map;                 /* Snapshot file mapping holding the arrays, NULL if they are on the heap */
+    size_t maplen;             /* Length of the snapshot file mapping */
+#ifdef CONTAINER_STATS
+    struct container_stats *stats; /* Runtime counters */
+#endif
 } hmap_t;
 
-void hmap_create(hmap_t *hmap, hash_f hasher, size_t init_cap, size_t keysize, size_t valsize);
+int hmap_create(hmap_t *hmap, hash_f hasher, size_t init_cap, size_t keysize, size_t valsize);
 void hmap_destroy(hmap_t *hmap);
 void *hmap_get(hmap_t const *hmap, void const *key);
+size_t hmap_get_batch(hmap_t const *hmap, void const *keys, size_t n, void **vals);
 void hmap_remove(hmap_t *hmap, void const *key);
-void hmap_put(hmap_t *hmap, void const *key, void const *value);
+int hmap_put(hmap_t *hmap, void const *key, void const *value);
+void *hmap_entry(hmap_t *hmap, void const *key, int *inserted);
+int hmap_add_u64(hmap_t *hmap, void const *key, uint64_t delta);
 size_t hmap_len(hmap_t const *hmap);
+void hmap_clear(hmap_t *hmap);
+int hmap_reserve(hmap_t *hmap, size_t n);
+int hmap_shrink_to_fit(hmap_t *hmap);
+int hmap_set_max_load(hmap_t *hmap, float max_load);
+int hmap_set_probing(hmap_t *hmap, enum hmap_probe_e probing);
+int hmap_set_dense(hmap_t *hmap, int dense);
+void hmap_probe_stats(hmap_t const *hmap, struct probe_stats *stats);
+void hmap_dump_stats(hmap_t const *hmap, FILE *stream);
+int hmap_save(hmap_t const *hmap, const char *path);
+int hmap_load_mmap(hmap_t *hmap, hash_f hasher, size_t keysize, size_t valsize, const char *path);
 void *hmap_iter_keys(hmap_t const *hmap, size_t *i, void **key);
 void *hmap_iter_vals(hmap_t const *hmap, size_t *i, void **val);
 void *hmap_iter_pairs(hmap_t const *hmap, size_t *i, void **key, void **val);
@@ -1,56 +1,134 @@
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "list.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define VEC_BYTES 32
+typedef __m256i vec_t;
+#elif defined(__SSE2__)
+#define VEC_BYTES 16
+typedef __m128i vec_t;
+#endif
+
+/* The smallest capacity a growing list allocates, so that small and empty lists don't reallocate on every append */
+#define MIN_CAPACITY 8
+
 /*
  * Constructs a new list.
  * @param list A pointer to the list to initialize
- * @param init_len the starting length of the list
+ * @param init_len the starting capacity of the list, which may be 0
  * @param elem_size the size of the elements to be stored in the list
  */
 void list_create(list_t *list, size_t init_len, size_t elem_size) {
     list->capacity = init_len;
     list->elem_size = elem_size;
     list->len = 0;
-    list->elements = malloc(init_len * elem_size);
+    list->inline_buf = NULL;
+    list->elements = init_len > 0 ? malloc(init_len * elem_size) : NULL;
     if (list->elements == NULL) {
-        list->len = 0;
+        list->capacity = 0;
         return;
     }
 }
 
+/*
+ * Constructs a new list that starts out in storage given by the caller, like an array on the stack, and only allocates
+ * once it outgrows it. `LIST_SMALL` declares a list with its storage alongside.
+ * @param list A pointer to the list to initialize
+ * @param buf The storage to start in, which must outlive the list
+ * @param n The number of elements that fit in `buf`
+ * @param elem_size the size of the elements to be stored in the list
+ */
+void list_create_inline(list_t *list, void *buf, size_t n, size_t elem_size) {
+    list->capacity = n;
+    list->elem_size = elem_size;
+    list->len = 0;
+    list->inline_buf = buf;
+    list->elements = buf;
+}
+
 /*
  * Frees the memory in the list.
  * @param list The list to free.
  */
 void list_destroy(list_t *list) {
-    free(list->elements);
+    if (list->elements != list->inline_buf) free(list->elements);
     list->elements = NULL;
+    list->capacity = 0;
+    list->len = 0;
+}
+
+/*
+ * Reallocates the backing array to hold exactly `capacity` elements. The list is left untouched on failure.
+ * @param list The list to reallocate
+ * @param capacity The new capacity, at least the length of the list
+ * @return 0 on success, ENOMEM if the array could not be allocated
+ */
+static int set_capacity(list_t *list, size_t capacity) {
+    if (list->elem_size > 0 && capacity > SIZE_MAX / list->elem_size) {
+        return ENOMEM;
+    }
+
+    /* A list still in its inline storage moves to the heap, since the storage isn't the list's to reallocate */
+
+    void *elements;
+    if (list->elements != NULL && list->elements == list->inline_buf) {
+        elements = malloc(capacity * list->elem_size);
+        if (elements != NULL) memcpy(elements, list->elements, list->len * list->elem_size);
+    } else {
+        elements = realloc(list->elements, capacity * list->elem_size);
+    }
+    if (elements == NULL) {
+        return ENOMEM;
+    }
+
+    list->elements = elements;
+    list->capacity = capacity;
+    return 0;
+}
+
+/*
+ * Makes room for at least `n` elements, at least doubling the capacity whenever it has to grow. This keeps appends
+ * amortized constant time whatever the starting capacity was.
+ * @param list The list to grow
+ * @param n The number of elements that must fit
+ * @return 0 on success, ENOMEM if the array could not be allocated
+ */
+static int grow(list_t *list, size_t n) {
+    if (n <= list->capacity) {
+        return 0;
+    }
+
+    size_t capacity = list->capacity * 2;
+    if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
+    if (capacity < n) capacity = n;
+    return set_capacity(list, capacity);
 }
 
 /*
  * Copy an item to the end of the list.
  * @param `list` A pointer to the list to append to.
  * @param `elem` the element to append.
- * @return 0 on success, errno on failure.
+ * @return 0 on success, ENOMEM if the list could not grow.
  */
 int list_append(list_t *list, void *element) {
 
-    assert(list->elements != NULL);
-
-    /* We need to add more space. Increase by ~30%. */
-    if (list->len + 1 > list->capacity) {
-        list->elements = realloc(list->elements, list->capacity * list->elem_size * 1.3);
-        if (list->elements == NULL) {
-            return errno;
+    if (list->len == list->capacity) {
+        int err = grow(list, list->len + 1);
+        if (err) {
+            return err;
         }
-
-        // Reallocated successfully, update capacity
-        list->capacity *= 1.3;
     }
 
     /* Add the element */
@@ -61,6 +139,107 @@ int list_append(list_t *list, void *element) {
     return 0;
 }
 
+/*
+ * Makes room for at least `n` elements in total, so that appending up to that many never reallocates.
+ * @param list The list to reserve space in
+ * @param n The number of elements to make room for
+ * @return 0 on success, ENOMEM if the array could not be allocated
+ */
+int list_reserve(list_t *list, size_t n) {
+    if (n <= list->capacity) {
+        return 0;
+    }
+    return set_capacity(list, n);
+}
+
+/*
+ * Copies `n` elements to the end of the list at once, growing it at most once.
+ * @param list The list to extend
+ * @param elements The array of elements to copy. It may point into the list itself.
+ * @param n The number of elements to copy
+ * @return 0 on success, ENOMEM if the list could not grow
+ */
+int list_extend(list_t *list, const void *elements, size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+
+    /* Growing moves the backing array, so elements copied from the list itself are found again by their offset */
+
+    uintptr_t src = (uintptr_t)elements;
+    uintptr_t base = (uintptr_t)list->elements;
+    int aliased = list->elements != NULL && src >= base && src < base + list->len * list->elem_size;
+
+    int err = grow(list, list->len + n);
+    if (err) {
+        return err;
+    }
+    if (aliased) {
+        elements = (uint8_t *)(list->elements) + (src - base);
+    }
+
+    memcpy((uint8_t *)(list->elements) + (list->len * list->elem_size), elements, n * list->elem_size);
+    list->len += n;
+    return 0;
+}
+
+/*
+ * Copies every element of `src` to the end of `dst`.
+ * @param dst The list to extend
+ * @param src The list to copy elements from, which may be `dst`
+ * @return 0 on success, EINVAL if the element sizes differ, ENOMEM if `dst` could not grow
+ */
+int list_extend_list(list_t *dst, list_t const *src) {
+    if (dst->elem_size != src->elem_size) {
+        return EINVAL;
+    }
+    return list_extend(dst, src->elements, src->len);
+}
+
+/*
+ * Sets the length of the list. Elements past the old length are zeroed, and elements past the new length are dropped.
+ * @param list The list to resize
+ * @param len The new length
+ * @return 0 on success, ENOMEM if the list could not grow
+ */
+int list_resize(list_t *list, size_t len) {
+    int err = grow(list, len);
+    if (err) {
+        return err;
+    }
+
+    if (len > list->len) {
+        memset((uint8_t *)(list->elements) + (list->len * list->elem_size), 0, (len - list->len) * list->elem_size);
+    }
+    list->len = len;
+    return 0;
+}
+
+/*
+ * Empties the list, keeping its backing array so it can be refilled without allocating.
+ * @param list The list to empty
+ */
+void list_reset(list_t *list) { list->len = 0; }
+
+/*
+ * Shrinks the backing array to fit the elements in the list. A list still in its inline storage is left alone.
+ * @param list The list to shrink
+ * @return 0 on success, ENOMEM if the array could not be reallocated
+ */
+int list_shrink_to_fit(list_t *list) {
+    if (list->len == list->capacity || list->elements == list->inline_buf) {
+        return 0;
+    }
+
+    if (list->len == 0) {
+        free(list->elements);
+        list->elements = NULL;
+        list->capacity = 0;
+        return 0;
+    }
+    return set_capacity(list, list->len);
+}
+
 /* Returns the length of the list
  * @param list The list to get the length of
  * @return The length of the list
@@ -108,6 +287,411 @@ int list_setindex(list_t *list, size_t i, const void *e) {
  */
 void list_sort(list_t *list, comparison_f comparison) { qsort(list->elements, list->len, list->elem_size, comparison); }
 
+/* Lists shorter than this are insertion sorted, since a radix sort's histograms and scratch array cost more than the
+ * sort itself */
+#define RADIX_MIN_LEN 64
+
+/* Number of buckets for each 8-bit digit of a key */
+#define RADIX_BUCKETS 256
+
+/*
+ * Turns a histogram of one digit into the index each bucket starts at. If every key has the same digit, the pass for
+ * that digit would not move anything.
+ * @param counts The histogram, replaced by the starting indices
+ * @param len The number of keys counted
+ * @return 1 if the pass is needed, 0 if it can be skipped
+ */
+static int radix_offsets(size_t counts[RADIX_BUCKETS], size_t len) {
+    size_t sum = 0;
+    for (size_t b = 0; b < RADIX_BUCKETS; b++) {
+        if (counts[b] == len) return 0;
+        size_t count = counts[b];
+        counts[b] = sum;
+        sum += count;
+    }
+    return 1;
+}
+
+/*
+ * LSD radix sorts 32-bit keys. Each pass scatters into a scratch array of the same size, which is the only allocation.
+ * @param keys The keys to sort
+ * @param len The number of keys
+ * @param flip XORed into every key before taking its digits, to order signed keys
+ * @return 0 on success, ENOMEM if the scratch array could not be allocated
+ */
+static int radix_sort_32(uint32_t *keys, size_t len, uint32_t flip) {
+    if (len < RADIX_MIN_LEN) {
+        for (size_t i = 1; i < len; i++) {
+            uint32_t key = keys[i];
+            size_t j = i;
+            for (; j > 0 && (keys[j - 1] ^ flip) > (key ^ flip); j--) {
+                keys[j] = keys[j - 1];
+            }
+            keys[j] = key;
+        }
+        return 0;
+    }
+
+    uint32_t *scratch = malloc(len * sizeof(uint32_t));
+    if (scratch == NULL) return ENOMEM;
+
+    /* Count every digit in one read of the keys */
+
+    size_t counts[sizeof(uint32_t)][RADIX_BUCKETS] = {0};
+    for (size_t i = 0; i < len; i++) {
+        uint32_t key = keys[i] ^ flip;
+        for (size_t d = 0; d < sizeof(uint32_t); d++) {
+            counts[d][(key >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    uint32_t *src = keys;
+    uint32_t *dst = scratch;
+    for (size_t d = 0; d < sizeof(uint32_t); d++) {
+        if (!radix_offsets(counts[d], len)) continue;
+
+        for (size_t i = 0; i < len; i++) {
+            dst[counts[d][((src[i] ^ flip) >> (d * 8)) & 0xff]++] = src[i];
+        }
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != keys) memcpy(keys, src, len * sizeof(uint32_t));
+    free(scratch);
+    return 0;
+}
+
+/*
+ * Swaps two non-overlapping runs of bytes.
+ * @param a The first run
+ * @param b The second run
+ * @param n The length of the runs in bytes
+ */
+static void swap_bytes(uint8_t *a, uint8_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint8_t tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+    }
+}
+
+/*
+ * LSD radix sorts 64-bit keys, optionally carrying an element along with each key.
+ * @param keys The keys to sort
+ * @param elems The elements to reorder along with the keys, or NULL to only sort the keys
+ * @param len The number of keys
+ * @param elem_size The size of each element
+ * @return 0 on success, ENOMEM if the scratch arrays could not be allocated
+ */
+static int radix_sort_64(uint64_t *keys, void *elems, size_t len, size_t elem_size) {
+    if (elems == NULL) elem_size = 0;
+
+    if (len < RADIX_MIN_LEN) {
+        for (size_t i = 1; i < len; i++) {
+            for (size_t j = i; j > 0 && keys[j - 1] > keys[j]; j--) {
+                uint64_t key = keys[j];
+                keys[j] = keys[j - 1];
+                keys[j - 1] = key;
+                if (elem_size) {
+                    swap_bytes((uint8_t *)elems + (j - 1) * elem_size, (uint8_t *)elems + j * elem_size, elem_size);
+                }
+            }
+        }
+        return 0;
+    }
+
+    uint64_t *scratch = malloc(len * sizeof(uint64_t));
+    uint8_t *elem_scratch = elem_size ? malloc(len * elem_size) : NULL;
+    if (scratch == NULL || (elem_size && elem_scratch == NULL)) {
+        free(scratch);
+        free(elem_scratch);
+        return ENOMEM;
+    }
+
+    size_t counts[sizeof(uint64_t)][RADIX_BUCKETS] = {0};
+    for (size_t i = 0; i < len; i++) {
+        for (size_t d = 0; d < sizeof(uint64_t); d++) {
+            counts[d][(keys[i] >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    uint64_t *src = keys;
+    uint64_t *dst = scratch;
+    uint8_t *esrc = elems;
+    uint8_t *edst = elem_scratch;
+    for (size_t d = 0; d < sizeof(uint64_t); d++) {
+        if (!radix_offsets(counts[d], len)) continue;
+
+        for (size_t i = 0; i < len; i++) {
+            size_t pos = counts[d][(src[i] >> (d * 8)) & 0xff]++;
+            dst[pos] = src[i];
+            if (elem_size) memcpy(edst + pos * elem_size, esrc + i * elem_size, elem_size);
+        }
+        uint64_t *tmp = src;
+        src = dst;
+        dst = tmp;
+        uint8_t *etmp = esrc;
+        esrc = edst;
+        edst = etmp;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, len * sizeof(uint64_t));
+        if (elem_size) memcpy(elems, esrc, len * elem_size);
+    }
+    free(scratch);
+    free(elem_scratch);
+    return 0;
+}
+
+/*
+ * Sorts a list of `uint32_t` in ascending order with a radix sort, which is much faster than `list_sort`.
+ * @param list The list to sort
+ * @return 0 on success, EINVAL if the elements are not 4 bytes, ENOMEM if the scratch array could not be allocated
+ */
+int list_sort_u32(list_t *list) {
+    if (list->elem_size != sizeof(uint32_t)) return EINVAL;
+    return radix_sort_32(list->elements, list->len, 0);
+}
+
+/*
+ * Sorts a list of `int32_t` (or `int`) in ascending order with a radix sort, which is much faster than `list_sort`.
+ * @param list The list to sort
+ * @return 0 on success, EINVAL if the elements are not 4 bytes, ENOMEM if the scratch array could not be allocated
+ */
+int list_sort_i32(list_t *list) {
+    if (list->elem_size != sizeof(int32_t)) return EINVAL;
+
+    /* Flipping the sign bit orders negative numbers before positive ones */
+    return radix_sort_32(list->elements, list->len, (uint32_t)1 << 31);
+}
+
+/*
+ * Sorts a list of `uint64_t` (or `size_t`) in ascending order with a radix sort, which is much faster than `list_sort`.
+ * @param list The list to sort
+ * @return 0 on success, EINVAL if the elements are not 8 bytes, ENOMEM if the scratch array could not be allocated
+ */
+int list_sort_u64(list_t *list) {
+    if (list->elem_size != sizeof(uint64_t)) return EINVAL;
+    return radix_sort_64(list->elements, NULL, list->len, 0);
+}
+
+/*
+ * Sorts a list of any element type in ascending order of an integer key, such as a field of a struct. The sort is
+ * stable, and `key` is called once per element.
+ * @param list The list to sort
+ * @param key The function returning each element's key. Signed keys should be cast to `uint64_t` with their sign bit
+ * flipped, so that negative keys come first.
+ * @return 0 on success, ENOMEM if the scratch arrays could not be allocated
+ */
+int list_sort_by_key(list_t *list, key_f key) {
+    uint64_t *keys = malloc((list->len > 0 ? list->len : 1) * sizeof(uint64_t));
+    if (keys == NULL) return ENOMEM;
+
+    for (size_t i = 0; i < list->len; i++) {
+        keys[i] = key((uint8_t *)(list->elements) + (i * list->elem_size));
+    }
+
+    int err = radix_sort_64(keys, list->elements, list->len, list->elem_size);
+    free(keys);
+    return err;
+}
+
+/* Lists shorter than this many elements per thread are sorted serially, since starting threads and merging would cost
+ * more than they save */
+#define PARALLEL_SORT_MIN_CHUNK 8192
+
+/* Most threads a parallel sort starts */
+#define PARALLEL_SORT_MAX_THREADS 64
+
+/* One thread's work in a parallel sort: sorting a chunk in place, or merging a slice of two sorted runs */
+typedef struct {
+    uint8_t *a;              /* The chunk to sort, or the slice of the first run to merge */
+    size_t alen;             /* Number of elements in `a` */
+    uint8_t *b;              /* The slice of the second run to merge, or NULL to sort `a` */
+    size_t blen;             /* Number of elements in `b` */
+    uint8_t *out;            /* Where the merged elements go */
+    size_t elem_size;        /* Size of the elements */
+    comparison_f comparison; /* The order to sort in */
+} sort_task_t;
+
+/*
+ * Do one thread's share of a parallel sort.
+ * @param arg The `sort_task_t` to do
+ * @return NULL
+ */
+static void *sort_task(void *arg) {
+    sort_task_t *task = arg;
+    size_t size = task->elem_size;
+
+    if (task->b == NULL) {
+        qsort(task->a, task->alen, size, task->comparison);
+        return NULL;
+    }
+
+    /* Ties take from the first run, matching how `merge_split` divides the runs between slices */
+
+    size_t i = 0;
+    size_t j = 0;
+    uint8_t *out = task->out;
+    while (i < task->alen && j < task->blen) {
+        if (task->comparison(task->b + j * size, task->a + i * size) < 0) {
+            memcpy(out, task->b + j++ * size, size);
+        } else {
+            memcpy(out, task->a + i++ * size, size);
+        }
+        out += size;
+    }
+    memcpy(out, task->a + i * size, (task->alen - i) * size);
+    out += (task->alen - i) * size;
+    memcpy(out, task->b + j * size, (task->blen - j) * size);
+    return NULL;
+}
+
+/*
+ * Find where a merge of two sorted runs crosses an output position, so that a merge can be split into independent
+ * slices. This is the merge path: a binary search along the diagonal of output position `diag`.
+ * @param a The first run
+ * @param alen The number of elements in `a`
+ * @param b The second run
+ * @param blen The number of elements in `b`
+ * @param diag The output position, at most `alen + blen`
+ * @param size The size of the elements
+ * @param comparison The order the runs are sorted in
+ * @return How many of the first `diag` merged elements come from `a`
+ */
+static size_t merge_split(const uint8_t *a, size_t alen, const uint8_t *b, size_t blen, size_t diag, size_t size,
+                          comparison_f comparison) {
+    size_t lo = diag > blen ? diag - blen : 0;
+    size_t hi = diag < alen ? diag : alen;
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (comparison(a + i * size, b + (diag - i - 1) * size) <= 0) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Run a batch of sort tasks, one per thread. The calling thread does the first task itself, and a task whose thread
+ * cannot be started is done by the calling thread too.
+ * @param tasks The tasks to run
+ * @param n The number of tasks
+ */
+static void run_sort_tasks(sort_task_t *tasks, size_t n) {
+    pthread_t threads[n];
+    int started[n];
+
+    for (size_t t = 1; t < n; t++) {
+        started[t] = pthread_create(&threads[t], NULL, sort_task, &tasks[t]) == 0;
+        if (!started[t]) sort_task(&tasks[t]);
+    }
+    sort_task(&tasks[0]);
+
+    for (size_t t = 1; t < n; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+}
+
+/*
+ * Sorts the list with several threads. The list is split into one chunk per thread, the chunks are sorted at the same
+ * time, and then pairs of sorted runs are merged until one is left. Every merge is split between all the threads, so
+ * none sit idle as the runs get longer. Short lists are sorted with `list_sort`, as are lists for which the scratch
+ * array cannot be allocated.
+ * @param list The list to sort
+ * @param comparison The function to use to compare two items
+ * @param nthreads The most threads to sort with
+ */
+void list_sort_parallel(list_t *list, comparison_f comparison, size_t nthreads) {
+
+    /* Use a power of two threads, so the runs pair up evenly in every round of merging */
+
+    size_t limit = list->len / PARALLEL_SORT_MIN_CHUNK;
+    if (nthreads > limit) nthreads = limit;
+    if (nthreads > PARALLEL_SORT_MAX_THREADS) nthreads = PARALLEL_SORT_MAX_THREADS;
+    size_t p = 1;
+    while (p * 2 <= nthreads) {
+        p *= 2;
+    }
+
+    uint8_t *scratch = p > 1 ? malloc(list->len * list->elem_size) : NULL;
+    if (scratch == NULL) {
+        list_sort(list, comparison);
+        return;
+    }
+
+    size_t size = list->elem_size;
+    size_t len = list->len;
+    sort_task_t tasks[p];
+
+    /* Sort the chunks */
+
+    size_t bounds[p + 1];
+    for (size_t t = 0; t <= p; t++) {
+        bounds[t] = len * t / p;
+    }
+    for (size_t t = 0; t < p; t++) {
+        tasks[t] = (sort_task_t){
+            .a = (uint8_t *)(list->elements) + bounds[t] * size,
+            .alen = bounds[t + 1] - bounds[t],
+            .b = NULL,
+            .elem_size = size,
+            .comparison = comparison,
+        };
+    }
+    run_sort_tasks(tasks, p);
+
+    /* Merge pairs of runs back and forth between the list and the scratch array. With `runs` runs left, each of the
+     * `runs / 2` merges is split into `p / (runs / 2)` slices along its merge path. */
+
+    uint8_t *src = list->elements;
+    uint8_t *dst = scratch;
+    for (size_t runs = p; runs > 1; runs /= 2) {
+        size_t slices = p / (runs / 2);
+
+        for (size_t m = 0; m < runs / 2; m++) {
+            size_t start = bounds[2 * m * (p / runs)];
+            size_t mid = bounds[(2 * m + 1) * (p / runs)];
+            size_t end = bounds[(2 * m + 2) * (p / runs)];
+            uint8_t *a = src + start * size;
+            uint8_t *b = src + mid * size;
+            size_t alen = mid - start;
+            size_t blen = end - mid;
+
+            size_t diag_lo = 0;
+            size_t i_lo = 0;
+            for (size_t s = 0; s < slices; s++) {
+                size_t diag_hi = (alen + blen) * (s + 1) / slices;
+                size_t i_hi = merge_split(a, alen, b, blen, diag_hi, size, comparison);
+                tasks[m * slices + s] = (sort_task_t){
+                    .a = a + i_lo * size,
+                    .alen = i_hi - i_lo,
+                    .b = b + (diag_lo - i_lo) * size,
+                    .blen = (diag_hi - i_hi) - (diag_lo - i_lo),
+                    .out = dst + (start + diag_lo) * size,
+                    .elem_size = size,
+                    .comparison = comparison,
+                };
+                diag_lo = diag_hi;
+                i_lo = i_hi;
+            }
+        }
+        run_sort_tasks(tasks, p);
+
+        uint8_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != list->elements) memcpy(list->elements, src, len * size);
+    free(scratch);
+}
+
 /*
  * Counts the number of times a condition is met in the list.
  * @param list The list to perform the count on
@@ -123,21 +707,152 @@ size_t list_count(list_t *list, const void *arg, count_f counter) {
     return count;
 }
 
+#ifdef VEC_BYTES
+
 /*
- * Checks if the given element is in the list at least once
- * @param list The list to check
+ * Broadcasts an element to every lane of a vector.
+ * @param e The element, 1, 4 or 8 bytes long
+ * @param elem_size The size of the element
+ * @return A vector holding copies of the element
+ */
+static inline vec_t vec_splat(const void *e, size_t elem_size) {
+    uint8_t b;
+    uint32_t d;
+    uint64_t q;
+    switch (elem_size) {
+    case 1:
+        memcpy(&b, e, 1);
+#if defined(__AVX2__)
+        return _mm256_set1_epi8(b);
+#else
+        return _mm_set1_epi8(b);
+#endif
+    case 4:
+        memcpy(&d, e, 4);
+#if defined(__AVX2__)
+        return _mm256_set1_epi32(d);
+#else
+        return _mm_set1_epi32(d);
+#endif
+    default:
+        memcpy(&q, e, 8);
+#if defined(__AVX2__)
+        return _mm256_set1_epi64x(q);
+#else
+        return _mm_set1_epi64x(q);
+#endif
+    }
+}
+
+/*
+ * Compares a vector's worth of elements against a splatted element.
+ * @param p The elements to compare, not necessarily aligned
+ * @param needle The splatted element
+ * @param elem_size The size of each element, 1, 4 or 8 bytes
+ * @return A mask with one bit per byte, every byte of an equal element being set
+ */
+static inline uint32_t vec_match(const uint8_t *p, vec_t needle, size_t elem_size) {
+#if defined(__AVX2__)
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    switch (elem_size) {
+    case 1:
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+    case 4:
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi32(v, needle));
+    default:
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi64(v, needle));
+    }
+#else
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    switch (elem_size) {
+    case 1:
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    case 4:
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(v, needle));
+    default: {
+        /* SSE2 has no 64-bit compare, so both 32-bit halves must match */
+        __m128i eq = _mm_cmpeq_epi32(v, needle);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_movemask_epi8(eq);
+    }
+    }
+#endif
+}
+
+/*
+ * Checks if elements of this size can be compared a vector at a time.
+ * @param elem_size The size of the elements
+ * @return 1 if there is a vector fast path, 0 otherwise
+ */
+static int vec_sized(size_t elem_size) { return elem_size == 1 || elem_size == 4 || elem_size == 8; }
+
+#endif // VEC_BYTES
+
+/*
+ * Finds the first element equal to `e`. Elements of 1, 4 or 8 bytes are compared a vector at a time.
+ * @param list The list to search
  * @param e The element to look for
- * @return 0 if element is not present, 1 if present
+ * @return The index of the element, or the length of the list if there is none
  */
-int list_in(list_t const *list, const void *e) {
-    for (size_t i = 0; i < list->len; i++) {
-        if (!memcmp(list_getindex(list, i), e, list->elem_size)) {
-            return 1;
+static size_t find_equal(list_t const *list, const void *e) {
+    const uint8_t *elements = list->elements;
+    size_t size = list->elem_size;
+    size_t i = 0;
+
+#ifdef VEC_BYTES
+    if (vec_sized(size)) {
+        vec_t needle = vec_splat(e, size);
+        size_t per_vec = VEC_BYTES / size;
+        for (; i + per_vec <= list->len; i += per_vec) {
+            uint32_t mask = vec_match(elements + i * size, needle, size);
+            if (mask) return i + __builtin_ctz(mask) / size;
         }
     }
-    return 0;
+#endif
+
+    for (; i < list->len; i++) {
+        if (!memcmp(elements + i * size, e, size)) return i;
+    }
+    return list->len;
 }
 
+/*
+ * Counts the elements equal to `e`. Elements of 1, 4 or 8 bytes are compared a vector at a time.
+ * @param list The list to count in
+ * @param e The element to count
+ * @return The number of elements equal to `e`
+ */
+size_t list_count_equal(list_t const *list, const void *e) {
+    const uint8_t *elements = list->elements;
+    size_t size = list->elem_size;
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef VEC_BYTES
+    if (vec_sized(size)) {
+        vec_t needle = vec_splat(e, size);
+        size_t per_vec = VEC_BYTES / size;
+        for (; i + per_vec <= list->len; i += per_vec) {
+            count += __builtin_popcount(vec_match(elements + i * size, needle, size));
+        }
+        count /= size;
+    }
+#endif
+
+    for (; i < list->len; i++) {
+        count += !memcmp(elements + i * size, e, size);
+    }
+    return count;
+}
+
+/*
+ * Checks if the given element is in the list at least once
+ * @param list The list to check
+ * @param e The element to look for
+ * @return 0 if element is not present, 1 if present
+ */
+int list_in(list_t const *list, const void *e) { return find_equal(list, e) < list->len; }
+
 /*
  * Returns the index of the first occurrence of `e`.
  * @param list The list to search
@@ -145,12 +860,120 @@ int list_in(list_t const *list, const void *e) {
  * @return A positive index corresponding to the first occurrence of the element, or -1 if not found.
  */
 long long list_index(list_t const *list, const void *e) {
-    for (size_t i = 0; i < list->len; i++) {
-        if (!memcmp(list_getindex(list, i), e, list->elem_size)) {
-            return i;
+    size_t i = find_equal(list, e);
+    return i < list->len ? (long long)i : -1;
+}
+
+/*
+ * Iterates over the runs of equal elements in a list, such as the distinct values of a sorted list and how many times
+ * each appears. Elements are compared byte for byte.
+ * @param list The list to iterate over
+ * @param i The index to start the next run at. Start iterating at 0; it is moved past the run.
+ * @param run_len Set to the number of elements in the run
+ * @return The first element of the run, or NULL once every run has been visited
+ */
+void *list_runs(list_t const *list, size_t *i, size_t *run_len) {
+    if (*i >= list->len) return NULL;
+
+    uint8_t *first = (uint8_t *)(list->elements) + (*i * list->elem_size);
+    size_t end = *i + 1;
+    while (end < list->len && !memcmp((uint8_t *)(list->elements) + (end * list->elem_size), first, list->elem_size)) {
+        end++;
+    }
+
+    *run_len = end - *i;
+    *i = end;
+    return first;
+}
+
+/*
+ * Walks two sorted lists in lockstep and calls `on_match` once for every value found in both. Each list is read once,
+ * so joins and frequency counts take linear time instead of a search of one list per element of the other.
+ * @param a The first list, sorted in the order of `comparison`
+ * @param b The second list, sorted in the order of `comparison`
+ * @param comparison The three-way comparison both lists are sorted by
+ * @param on_match Called with the run of equal elements from each list. A non-zero return stops the join.
+ * @param arg Passed to `on_match`
+ * @return 0 once the join is done, or the first non-zero value returned by `on_match`
+ */
+int list_merge_join(list_t const *a, list_t const *b, comparison_f comparison, join_f on_match, void *arg) {
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < a->len && j < b->len) {
+        uint8_t *ea = (uint8_t *)(a->elements) + (i * a->elem_size);
+        uint8_t *eb = (uint8_t *)(b->elements) + (j * b->elem_size);
+
+        int order = comparison(ea, eb);
+        if (order < 0) {
+            i++;
+            continue;
+        }
+        if (order > 0) {
+            j++;
+            continue;
+        }
+
+        /* Take the whole run of equal elements from each side */
+
+        size_t a_end = i + 1;
+        while (a_end < a->len && comparison((uint8_t *)(a->elements) + (a_end * a->elem_size), eb) == 0) {
+            a_end++;
+        }
+        size_t b_end = j + 1;
+        while (b_end < b->len && comparison(ea, (uint8_t *)(b->elements) + (b_end * b->elem_size)) == 0) {
+            b_end++;
+        }
+
+        int err = on_match(ea, a_end - i, eb, b_end - j, arg);
+        if (err) return err;
+        i = a_end;
+        j = b_end;
+    }
+    return 0;
+}
+
+/*
+ * Finds the first element of a sorted list that is not less than `e`, by binary search.
+ * @param list The list to search, sorted in the order of `comparison`
+ * @param e The element to search for
+ * @param comparison The three-way comparison the list is sorted by
+ * @return The index of the first element not less than `e`, or the length of the list if there is none
+ */
+size_t list_lower_bound(list_t const *list, const void *e, comparison_f comparison) {
+    size_t lo = 0;
+    size_t hi = list->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (comparison((uint8_t *)(list->elements) + (mid * list->elem_size), e) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Finds the first element of a sorted list that is greater than `e`, by binary search. Together with
+ * `list_lower_bound` this gives the range of elements equal to `e`.
+ * @param list The list to search, sorted in the order of `comparison`
+ * @param e The element to search for
+ * @param comparison The three-way comparison the list is sorted by
+ * @return The index of the first element greater than `e`, or the length of the list if there is none
+ */
+size_t list_upper_bound(list_t const *list, const void *e, comparison_f comparison) {
+    size_t lo = 0;
+    size_t hi = list->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (comparison((uint8_t *)(list->elements) + (mid * list->elem_size), e) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
-    return -1;
+    return lo;
 }
 
 /* Pop an element from the end of the list and store it in `e`.
@@ -1,6 +1,7 @@
 #ifndef _LIST_H_
 #define _LIST_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 
 /* A dynamic array for any element type. */
@@ -9,22 +10,57 @@ typedef struct {
     size_t len;       /* The length of the list based on stored elements. */
     size_t elem_size; /* Size of the elements in bytes. */
     size_t capacity;  /* Capacity of backing array, in number of elements */
+    void *inline_buf; /* Storage the list started in that it doesn't own, or NULL if it started on the heap */
 } list_t;
 
+/* A list with room for `n` elements of `type` inside the struct, which only allocates once it outgrows them. Create it
+ * with `list_create_small` and use its `list` member like any other list. It must not be moved or copied while in use,
+ * since the list points into the struct. */
+#define LIST_SMALL(type, n)                                                                                            \
+    struct {                                                                                                           \
+        list_t list;                                                                                                   \
+        type inline_elems[n];                                                                                          \
+    }
+
+/* Initialize a list declared with `LIST_SMALL` to start in its inline storage */
+#define list_create_small(small)                                                                                       \
+    list_create_inline(&(small)->list, (small)->inline_elems,                                                          \
+                       sizeof((small)->inline_elems) / sizeof((small)->inline_elems[0]),                               \
+                       sizeof((small)->inline_elems[0]))
+
 typedef int (*comparison_f)(const void *a, const void *b);
 typedef int (*count_f)(const void *e, const void *arg);
+typedef uint64_t (*key_f)(const void *e);
+typedef int (*join_f)(const void *a, size_t a_count, const void *b, size_t b_count, void *arg);
 
 void list_create(list_t *list, size_t init_len, size_t elem_size);
+void list_create_inline(list_t *list, void *buf, size_t n, size_t elem_size);
 void list_destroy(list_t *list);
 
 int list_append(list_t *list, void *element);
+int list_reserve(list_t *list, size_t n);
+int list_extend(list_t *list, const void *elements, size_t n);
+int list_extend_list(list_t *dst, list_t const *src);
+int list_resize(list_t *list, size_t len);
+int list_shrink_to_fit(list_t *list);
+void list_reset(list_t *list);
 size_t list_len(list_t const *list);
 void *list_getindex(list_t const *list, size_t i);
 int list_in(list_t const *list, const void *e);
 int list_setindex(list_t *list, size_t i, const void *e);
 void list_sort(list_t *list, comparison_f comparison);
+int list_sort_u32(list_t *list);
+int list_sort_i32(list_t *list);
+int list_sort_u64(list_t *list);
+int list_sort_by_key(list_t *list, key_f key);
+void list_sort_parallel(list_t *list, comparison_f comparison, size_t nthreads);
 size_t list_count(list_t *list, const void *arg, count_f counter);
+size_t list_count_equal(list_t const *list, const void *e);
 long long list_index(list_t const *list, const void *e);
 void list_pop(list_t *list, void *e);
+void *list_runs(list_t const *list, size_t *i, size_t *run_len);
+int list_merge_join(list_t const *a, list_t const *b, comparison_f comparison, join_f on_match, void *arg);
+size_t list_lower_bound(list_t const *list, const void *e, comparison_f comparison);
+size_t list_upper_bound(list_t const *list, const void *e, comparison_f comparison);
 
 #endif // _LIST_H_
@@ -1,93 +1,144 @@
+#include <errno.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "ctrl.h"
 #include "set.h"
+#include "snapshot.h"
 
-enum slot_e {
-    SLOT_EMPTY = 0, /* Empty slot */
-    SLOT_DEL = 1,   /* Something was here, but got deleted */
-    SLOT_OCC = 2,   /* Slot occupied */
-};
-
-#define get16bits(d) ((((uint32_t)(((const uint8_t *)(d))[1])) << 8) + (uint32_t)(((const uint8_t *)(d))[0]))
-
-/* Fast hashing function taken from http://www.azillionmonkeys.com/qed/hash.html.
- * Author: Paul Hsieh
- * Licensed under LGPL2.1 license.
- * Should be way better than anything I can make.
- */
-static uint32_t fasthash(const uint8_t *data, size_t len) {
-    uint32_t hash = len, tmp;
-    int rem;
-
-    if (len <= 0 || data == NULL) return 0;
-
-    rem = len & 3;
-    len >>= 2;
-
-    /* Main loop */
-    for (; len > 0; len--) {
-        hash += get16bits(data);
-        tmp = (get16bits(data + 2) << 11) ^ hash;
-        hash = (hash << 16) ^ tmp;
-        data += 2 * sizeof(uint16_t);
-        hash += hash >> 11;
-    }
-
-    /* Handle end cases */
-    switch (rem) {
-    case 3:
-        hash += get16bits(data);
-        hash ^= hash << 16;
-        hash ^= ((signed char)data[sizeof(uint16_t)]) << 18;
-        hash += hash >> 11;
-        break;
-    case 2:
-        hash += get16bits(data);
-        hash ^= hash << 11;
-        hash += hash >> 17;
-        break;
-    case 1:
-        hash += (signed char)*data;
-        hash ^= hash << 10;
-        hash += hash >> 1;
-    }
-
-    /* Force "avalanching" of final 127 bits */
-    hash ^= hash << 3;
-    hash += hash >> 5;
-    hash ^= hash << 4;
-    hash += hash >> 17;
-    hash ^= hash << 25;
-    hash += hash >> 6;
-
-    return hash;
+/* Probing works on whole groups of slots */
+#define MIN_CAPACITY GROUP_WIDTH
+
+/* Number of elements that batched operations hash and prefetch before probing for any of them */
+#define BATCH_LEN 16
+
+/* Layout of the Bloom filter. Each element sets `BLOOM_HASHES` bits in one block the size of a cache line, so checking
+ * an element touches one line. About 8 bits per element keeps false positives near 2% while the filter stays a little
+ * smaller than the control bytes. */
+#define BLOOM_BLOCK_WORDS 8 /* 64-bit words per block */
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+#define BLOOM_BITS_PER_ELEM 8
+#define BLOOM_HASHES 4
+
+/* Calculate how many occupied or deleted slots a backing array can have before it must be rehashed.
+ * @param capacity The capacity of the backing array
+ * @param max_load The maximum load factor of the backing array
+ * @return The number of slots that can be used, always leaving at least one empty slot to terminate probing
+ */
+static size_t load_limit(size_t capacity, float max_load) {
+    size_t limit = (double)capacity * max_load;
+    if (limit >= capacity) limit = capacity - 1;
+    return limit;
+}
+
+/* Calculate the capacity required to store `n` elements without exceeding the maximum load factor.
+ * @param n The number of elements to store
+ * @param max_load The maximum load factor of the backing array
+ * @return The smallest power of two capacity that can fit `n` elements
+ */
+static size_t capacity_for(size_t n, float max_load) {
+    size_t capacity = MIN_CAPACITY;
+    while (load_limit(capacity, max_load) < n) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/* Get the size of one slot of the set: a whole element, or an index into the dense array of elements.
+ * @param set The set whose layout to use
+ * @return The size of a slot in bytes
+ */
+static size_t slot_size(const set_t *set) { return set->dense ? sizeof(uint32_t) : set->elemsize; }
+
+/* Get the number of bytes allocated for the set's arrays.
+ * @param set The set to measure
+ * @return The size of the control bytes, slots, dense array and Bloom filter together
+ */
+static size_t allocated_bytes(set_t const *set) {
+    return set->capacity * (sizeof(uint8_t) + slot_size(set)) + set->entries_cap * set->elemsize +
+           set->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+/* Update the runtime counters after the length or capacity of the set changed.
+ * @param set The set that changed
+ */
+static void record_occupancy(set_t const *set) { STATS_OCCUPANCY(set, set->len, set->capacity, allocated_bytes(set)); }
+
+/* Free a set's arrays, or unmap the snapshot file they live in.
+ * @param set The set the arrays belonged to
+ * @param ctrl The control byte array
+ * @param elems The element array
+ */
+static void free_arrays(set_t *set, uint8_t *ctrl, void *elems) {
+    if (set->map != NULL) {
+        snapshot_unmap(set->map, set->maplen);
+        set->map = NULL;
+        return;
+    }
+    free(ctrl);
+    free(elems);
 }
 
 /* Create a new set
  * @param set The set to initialize
- * @param hasher The hash function to use. Pass NULL to use the default hasher by Paul Hsieh
- * @param init_cap The initial capacity of the set
+ * @param hasher The hash function to use. Pass NULL to use `hash_default`
+ * @param init_cap The number of elements to reserve space for. The set grows past this as needed.
  * @param elemsize The size of each element in bytes
+ * @return 0 on success, ENOMEM if the backing array could not be allocated. The set is then empty with no capacity,
+ * but can still be destroyed.
  */
-void set_create(set_t *set, hash_f hasher, size_t init_cap, size_t elemsize) {
+int set_create(set_t *set, hash_f hasher, size_t init_cap, size_t elemsize) {
     set->elemsize = elemsize;
     set->hasher = hasher;
-    if (hasher == NULL) set->hasher = fasthash;
-    set->capacity = init_cap;
+    if (hasher == NULL) set->hasher = hash_default;
     set->len = 0;
+    set->tombs = 0;
+    set->max_load = SET_DEFAULT_MAX_LOAD;
+    set->probing = SET_GROUP;
+    set->map = NULL;
+    set->dense = 0;
+    set->entries = NULL;
+    set->entries_cap = 0;
+    set->bloom = NULL;
+    set->bloom_blocks = 0;
+
+    set->capacity = capacity_for(init_cap, set->max_load);
+    set->limit = load_limit(set->capacity, set->max_load);
 
-    /* Allocate a little extra space for tracking slot state */
-    size_t byte_cap = init_cap * elemsize + init_cap * sizeof(uint8_t);
-    set->elems = malloc(byte_cap);
-    memset(set->elems, 0, byte_cap);
+    /* Control bytes live in their own array, away from the elements. Each element sits at a multiple of its size, so it
+     * stays at its natural alignment. */
+
+    set->ctrl = ctrl_alloc(set->capacity);
+    set->elems = malloc(set->capacity * elemsize);
+
+    int err = 0;
+    if (set->ctrl == NULL || set->elems == NULL) {
+        free(set->ctrl);
+        free(set->elems);
+        set->ctrl = NULL;
+        set->elems = NULL;
+        set->capacity = 0;
+        set->limit = 0;
+        err = ENOMEM;
+    }
+
+    STATS_REGISTER(set, "set");
+    record_occupancy(set);
+    return err;
 }
 
 /* Free a set.
  * @param set The set to destroy.
  */
 void set_destroy(set_t *set) {
-    free(set->elems);
+#ifdef CONTAINER_STATS
+    struct probe_stats final;
+    set_probe_stats(set, &final);
+    stats_destroyed(set->stats, &final);
+#endif
+    free_arrays(set, set->ctrl, set->elems);
+    free(set->entries);
+    free(set->bloom);
     memset(set, 0, sizeof(set_t));
 }
 
@@ -97,98 +148,604 @@ void set_destroy(set_t *set) {
  */
 size_t set_len(set_t const *set) { return set->len; }
 
-/* Hash an element into an index into the backing array.
- * @param set The set to hash the element for.
- * @param elem The element to hash
- * @return The hashed element, guaranteed to be a number that can safely index the set's backing array.
+/* Get slot `i` of the set.
+ * @param set The set to index into
+ * @param i The slot's index
+ * @return A pointer to the start of the slot
+ */
+static void *slot_ptr(const set_t *set, size_t i) { return (uint8_t *)(set->elems) + (slot_size(set) * i); }
+
+/* Get the element at index `e` of the dense array.
+ * @param set The dense set to index into
+ * @param e The element's index in insertion order
+ * @return A pointer to the element
  */
-static size_t hash(const set_t *set, const void *elem) { return set->hasher(elem, set->elemsize) % set->capacity; }
+static void *entry(const set_t *set, size_t e) { return (uint8_t *)set->entries + e * set->elemsize; }
 
 /*
- * Gets the slot at index `i` and its state.
+ * Gets the element in slot `i`.
  * @param set The set to get the slot from.
  * @param i The slot's index
- * @param state A pointer to the slot's state
- * @return A pointer to the start of the element.
+ * @return A pointer to the start of the element, inside the dense array if the slot holds an index.
  */
-static void *get_slot(const set_t *set, size_t i, uint8_t **state) {
+static void *get_slot(const set_t *set, size_t i) {
+    if (set->dense) return entry(set, *(uint32_t *)slot_ptr(set, i));
+    return slot_ptr(set, i);
+}
 
-    /* Get the current slot, which has the state as the header */
-    *state = (uint8_t *)(set->elems) + ((set->elemsize + 1) * i);
-    return *state + 1; /* Element is 1 byte after state */
+/* Allocate an empty Bloom filter big enough for a backing array's worth of elements.
+ * @param limit The most elements the backing array holds before it is rebuilt
+ * @param blocks Where to store the number of blocks in the filter
+ * @return The filter, to be released with `free`, or NULL if it could not be allocated
+ */
+static uint64_t *bloom_alloc(size_t limit, size_t *blocks) {
+    *blocks = 1;
+    while (*blocks * BLOOM_BLOCK_BITS < limit * BLOOM_BITS_PER_ELEM) {
+        *blocks <<= 1;
+    }
+
+    size_t bytes = *blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    uint64_t *bloom = aligned_alloc(BLOOM_BLOCK_WORDS * sizeof(uint64_t), bytes);
+    if (bloom != NULL) memset(bloom, 0, bytes);
+    return bloom;
 }
 
-/* Add an element to the set
- * @param set The set to add to.
- * @param elem The element to add.
+/* Get the Bloom filter block that an element's bits are in. The set's hash is remixed so that the block and bits are
+ * chosen independently of the hash bits that pick the element's slot.
+ * @param set The set whose filter to use
+ * @param hash The hash of the element
+ * @param mixed Where to store the remixed hash, whose low bits pick the bits within the block
+ * @return The first word of the block
  */
-void set_add(set_t *set, const void *elem) {
-    size_t index = hash(set, elem);
-    size_t i = index;
-    void *cur;
-    uint8_t *state;
+static uint64_t *bloom_block(const set_t *set, uint32_t hash, uint64_t *mixed) {
+    *mixed = hash_mix64(hash);
+    return set->bloom + ((*mixed >> 40) & (set->bloom_blocks - 1)) * BLOOM_BLOCK_WORDS;
+}
+
+/* Record an element in the set's Bloom filter.
+ * @param set The set with a filter
+ * @param hash The hash of the element
+ */
+static void bloom_add(set_t *set, uint32_t hash) {
+    uint64_t mixed;
+    uint64_t *block = bloom_block(set, hash, &mixed);
+    for (size_t k = 0; k < BLOOM_HASHES; k++, mixed >>= 9) {
+        size_t bit = mixed & (BLOOM_BLOCK_BITS - 1);
+        block[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
 
-    /* Linearly probe for an empty slot */
+/* Check an element against the set's Bloom filter.
+ * @param set The set with a filter
+ * @param hash The hash of the element
+ * @return 0 if the element is definitely not in the set, 1 if it might be
+ */
+static int bloom_test(const set_t *set, uint32_t hash) {
+    uint64_t mixed;
+    const uint64_t *block = bloom_block(set, hash, &mixed);
+    for (size_t k = 0; k < BLOOM_HASHES; k++, mixed >>= 9) {
+        size_t bit = mixed & (BLOOM_BLOCK_BITS - 1);
+        if (!(block[bit / 64] & ((uint64_t)1 << (bit % 64)))) return 0;
+    }
+    return 1;
+}
+
+/* Rebuild the set's Bloom filter from its elements.
+ * @param set The set with a filter
+ */
+static void bloom_fill(set_t *set) {
+    memset(set->bloom, 0, set->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+
+    size_t i = 0;
+    void *elem;
+    while (set_iter(set, &i, &elem) != NULL) {
+        bloom_add(set, set->hasher(elem, set->elemsize));
+    }
+}
+
+/* Probe the set for an element, one group of control bytes at a time.
+ * @param set The set to search
+ * @param elem The element to look for
+ * @param hash The hash of `elem`
+ * @param slot Where to store the index of the matching slot, or the first free slot on the probe sequence if the
+ * element is not in the set
+ * @param probes Where to store the number of groups visited
+ * @return 1 if the element was found, 0 otherwise
+ */
+static int group_probe(const set_t *set, const void *elem, uint32_t hash, size_t *slot, size_t *probes) {
+    struct probeseq seq = probeseq_start(hash, set->capacity);
+    int have_free = 0;
 
-    do {
+    /* The load limit always leaves an empty slot, but never visit a group twice even if deleted slots fill the set */
 
-        cur = get_slot(set, i, &state);
+    for (size_t n = 0; n <= seq.mask; n++, probeseq_next(&seq)) {
+        size_t offset = probeseq_offset(&seq);
+        const uint8_t *ctrl = set->ctrl + offset;
+        *probes = n + 1;
 
-        /* Copy element into first available slot */
+        /* Only compare the elements in slots whose control byte matches the element's hash */
 
-        if (*state == SLOT_EMPTY || *state == SLOT_DEL) {
-            memcpy(cur, elem, set->elemsize);
-            *state = SLOT_OCC;
-            set->len++;
-            break;
+        groupmask_t match = group_match(ctrl, H2(hash));
+        while (match) {
+            size_t i = offset + group_next(&match);
+            if (!memcmp(get_slot(set, i), elem, set->elemsize)) {
+                *slot = i;
+                return 1;
+            }
         }
 
-        /* If slot is occupied, check if the element is already there. Don't add duplicates */
+        /* Remember the first free slot to insert into */
 
-        if (*state == SLOT_OCC && !memcmp(cur, elem, set->elemsize)) {
-            return;
+        if (!have_free) {
+            groupmask_t free = group_match_free(ctrl);
+            if (free) {
+                *slot = offset + group_next(&free);
+                have_free = 1;
+            }
         }
 
-        i = (i + 1) % set->capacity; /* Loop around */
+        /* If part of this group is empty, end here because it means the element was never further along */
+
+        if (group_match_empty(ctrl)) return 0;
+    }
 
-    } while (i != index);
+    /* We visited every group and found nothing */
+    return 0;
 }
 
-/* Remove an element to the set
+/* Get how far the element in slot `i` of a Robin Hood set is from its home slot.
+ * @param set The set to check
+ * @param i The index of a full slot
+ * @return The distance of the element from its home slot
+ */
+static size_t rh_dist(const set_t *set, size_t i) {
+    if (set->ctrl[i] < RH_MAX_DIST) return set->ctrl[i];
+    return (i - rh_home(set->hasher(get_slot(set, i), set->elemsize), set->capacity)) & (set->capacity - 1);
+}
+
+/* Linearly probe a Robin Hood set for an element. Elements along a run are ordered by their home slot, so the search
+ * can stop as soon as it reaches an element that is closer to its home than `elem` would be.
+ * @param set The set to search
+ * @param elem The element to look for
+ * @param hash The hash of `elem`
+ * @param slot Where to store the index of the matching slot, or the slot the element should be inserted at if it is not
+ * in the set
+ * @param probes Where to store the number of slots visited
+ * @return 1 if the element was found, 0 otherwise
+ */
+static int rh_probe(const set_t *set, const void *elem, uint32_t hash, size_t *slot, size_t *probes) {
+    size_t mask = set->capacity - 1;
+    size_t i = rh_home(hash, set->capacity);
+
+    /* Visit every slot at most once in case the set is full */
+
+    for (size_t dist = 0; dist < set->capacity; dist++, i = (i + 1) & mask) {
+        *probes = dist + 1;
+        if (set->ctrl[i] == CTRL_EMPTY) break;
+
+        size_t cur = rh_dist(set, i);
+        if (cur < dist) break;
+        if (cur == dist && !memcmp(get_slot(set, i), elem, set->elemsize)) {
+            *slot = i;
+            return 1;
+        }
+    }
+
+    *slot = i;
+    return 0;
+}
+
+/* Probe the set for an element with the set's probing scheme.
+ * @param set The set to search
+ * @param elem The element to look for
+ * @param hash The hash of `elem`
+ * @param slot Where to store the index of the matching slot, or where the element should be inserted if it is not in
+ * the set
+ * @param probes Where to store the length of the probe sequence that was walked
+ * @return 1 if the element was found, 0 otherwise
+ */
+static int probe(const set_t *set, const void *elem, uint32_t hash, size_t *slot, size_t *probes) {
+    if (set->probing == SET_ROBIN) {
+        return rh_probe(set, elem, hash, slot, probes);
+    }
+    return group_probe(set, elem, hash, slot, probes);
+}
+
+/* Probe the set for an element on behalf of the user, counting the probe sequence in the runtime counters.
+ * @param set The set to search
+ * @param elem The element to look for
+ * @param hash The hash of `elem`
+ * @param slot Where to store the index of the matching slot, or where the element should be inserted if it is not in
+ * the set
+ * @return 1 if the element was found, 0 otherwise
+ */
+static int lookup(const set_t *set, const void *elem, uint32_t hash, size_t *slot) {
+    size_t probes = 0;
+    int found = probe(set, elem, hash, slot, &probes);
+    STATS_PROBE(set, probes);
+    return found;
+}
+
+/* Look for an element on behalf of the user, checking the Bloom filter first if the set has one so that most missing
+ * elements are rejected without probing. Insertions use `lookup` instead, since they need the slot to insert into.
+ * @param set The set to search
+ * @param elem The element to look for
+ * @param hash The hash of `elem`
+ * @param slot Where to store the index of the matching slot. Not meaningful if the element is not found.
+ * @return 1 if the element was found, 0 otherwise
+ */
+static int find(const set_t *set, const void *elem, uint32_t hash, size_t *slot) {
+    if (set->bloom == NULL) return lookup(set, elem, hash, slot);
+
+    if (!bloom_test(set, hash)) {
+        STATS_FILTER(set, 0, 0);
+        return 0;
+    }
+
+    int found = lookup(set, elem, hash, slot);
+    STATS_FILTER(set, 1, found);
+    return found;
+}
+
+/* Prepare slot `i` to receive a new element. In a Robin Hood set, the run of elements starting at `i` is shifted
+ * forward by one slot to make room.
+ * @param set The set to insert into
+ * @param i The slot returned by `probe` for the new element
+ * @param hash The hash of the new element
+ */
+static void claim(set_t *set, size_t i, uint32_t hash) {
+    size_t mask = set->capacity - 1;
+
+    if (set->probing == SET_GROUP) {
+        if (set->ctrl[i] == CTRL_DEL) set->tombs--;
+        set->ctrl[i] = H2(hash);
+        return;
+    }
+
+    /* Find the end of the run, then move each element one slot further from its home */
+
+    size_t end = i;
+    while (set->ctrl[end] != CTRL_EMPTY) {
+        end = (end + 1) & mask;
+    }
+
+    for (size_t j = end; j != i; j = (j - 1) & mask) {
+        size_t prev = (j - 1) & mask;
+        memcpy(slot_ptr(set, j), slot_ptr(set, prev), slot_size(set));
+        set->ctrl[j] = rh_ctrl(set->ctrl[prev] + 1);
+    }
+
+    set->ctrl[i] = rh_ctrl((i - rh_home(hash, set->capacity)) & mask);
+}
+
+/* Remove the element in slot `i`.
  * @param set The set to remove from
- * @param elem The element to remove
+ * @param i The index of a full slot
  */
-void set_remove(set_t *set, const void *elem) {
-    size_t index = hash(set, elem);
-    size_t i = index;
-    void *cur;
-    uint8_t *state;
+static void release(set_t *set, size_t i) {
+    size_t mask = set->capacity - 1;
+
+    /* If the slot's group already has an empty slot, no probe ever passes through the group, so the slot can be emptied
+     * instead of leaving a deleted marker behind. */
+
+    if (set->probing == SET_GROUP) {
+        if (group_match_empty(set->ctrl + i / GROUP_WIDTH * GROUP_WIDTH)) {
+            set->ctrl[i] = CTRL_EMPTY;
+        } else {
+            set->ctrl[i] = CTRL_DEL;
+            set->tombs++;
+        }
+        return;
+    }
 
-    /* Linearly probe for matching slot */
+    /* Robin Hood sets shift the rest of the run back by one slot, so nothing is left behind */
 
-    do {
+    size_t next = (i + 1) & mask;
+    while (set->ctrl[next] != CTRL_EMPTY) {
+        size_t dist = rh_dist(set, next);
+        if (dist == 0) break; /* Already home, the run ends here */
 
-        /* Get the current slot */
+        memcpy(slot_ptr(set, i), slot_ptr(set, next), slot_size(set));
+        set->ctrl[i] = rh_ctrl(dist - 1);
+        i = next;
+        next = (next + 1) & mask;
+    }
+    set->ctrl[i] = CTRL_EMPTY;
+}
 
-        cur = get_slot(set, i, &state);
+/* Move all elements into a new backing array, dropping any deleted markers. If the set has a dense array of elements,
+ * the elements are taken from it instead of the old backing array, and only their indices are stored if it is still
+ * dense.
+ * @param set The set to rehash
+ * @param capacity The capacity of the new backing array, must be a power of two large enough for all elements
+ * @return 0 on success, ENOMEM if the new backing array could not be allocated
+ */
+static int rehash(set_t *set, size_t capacity) {
+    uint8_t *old_ctrl = set->ctrl;
+    void *old_elems = set->elems;
+    size_t old_cap = set->capacity;
 
-        /* If an empty slot was found, end here because it means nothing was ever here */
+    /* The Bloom filter is rebuilt along with the backing array, which also forgets removed elements */
 
-        if (*state == SLOT_EMPTY) return;
+    size_t bloom_blocks = 0;
+    uint64_t *bloom = NULL;
+    if (set->bloom != NULL) bloom = bloom_alloc(load_limit(capacity, set->max_load), &bloom_blocks);
 
-        /* A matching element was found, delete it */
+    uint8_t *ctrl = ctrl_alloc(capacity);
+    void *elems = malloc(capacity * slot_size(set));
+    if (ctrl == NULL || elems == NULL || (set->bloom != NULL && bloom == NULL)) {
+        free(ctrl);
+        free(elems);
+        free(bloom);
+        return ENOMEM;
+    }
 
-        if (*state == SLOT_OCC && !memcmp(cur, elem, set->elemsize)) {
-            *state = SLOT_DEL;
-            set->len--;
-            break;
+    set->ctrl = ctrl;
+    set->elems = elems;
+    set->capacity = capacity;
+    set->limit = load_limit(capacity, set->max_load);
+    set->tombs = 0;
+    if (bloom != NULL) {
+        free(set->bloom);
+        set->bloom = bloom;
+        set->bloom_blocks = bloom_blocks;
+    }
+
+    /* Elements are unique, so probing only finds the slot to insert each element into */
+
+    size_t n = set->entries != NULL ? set->len : old_cap;
+    for (size_t i = 0; i < n; i++) {
+        void *elem;
+        if (set->entries != NULL) {
+            elem = entry(set, i);
+        } else if (ctrl_full(old_ctrl[i])) {
+            elem = (uint8_t *)old_elems + i * set->elemsize;
+        } else {
+            continue;
         }
 
-        /* If matching slot not found, continue looping */
+        uint32_t hash = set->hasher(elem, set->elemsize);
+        size_t j, probes;
+        probe(set, elem, hash, &j, &probes);
+        claim(set, j, hash);
+        if (set->dense) {
+            *(uint32_t *)slot_ptr(set, j) = i;
+        } else {
+            memcpy(slot_ptr(set, j), elem, set->elemsize);
+        }
+        if (set->bloom != NULL) bloom_add(set, hash);
+    }
 
-        i = (i + 1) % set->capacity; /* Loop around */
+    free_arrays(set, old_ctrl, old_elems);
+    STATS_REHASH(set);
+    record_occupancy(set);
+    return 0;
+}
 
-    } while (i != index);
+/* Get the first slot that a probe for `hash` looks at: the start of its first group, or its home slot in a Robin Hood
+ * set.
+ * @param set The set to probe
+ * @param hash The hash of the element being probed for
+ * @return The index of the slot
+ */
+static size_t first_slot(const set_t *set, uint32_t hash) {
+    if (set->probing == SET_ROBIN) {
+        return rh_home(hash, set->capacity);
+    }
+    struct probeseq seq = probeseq_start(hash, set->capacity);
+    return probeseq_offset(&seq);
+}
+
+/* Prefetch everything the probes for a block of hashes will touch first. Control bytes are requested for the whole
+ * block before any of them are read, then the element slots they point at.
+ * @param set The set to probe
+ * @param hashes The hashes of the elements that will be probed for
+ * @param len The number of hashes, at most `BATCH_LEN`
+ */
+static void prefetch_hashes(const set_t *set, const uint32_t *hashes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (set->bloom != NULL) {
+            uint64_t mixed;
+            __builtin_prefetch(bloom_block(set, hashes[i], &mixed));
+        }
+        __builtin_prefetch(set->ctrl + first_slot(set, hashes[i]));
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        size_t slot = first_slot(set, hashes[i]);
+        if (set->probing == SET_GROUP) {
+            groupmask_t match = group_match(set->ctrl + slot, H2(hashes[i]));
+            if (!match) continue;
+            slot += group_next(&match);
+        }
+        __builtin_prefetch(slot_ptr(set, slot));
+    }
+}
+
+/* Hash a block of elements and prefetch everything their probes will touch first.
+ * @param set The set to probe
+ * @param elems A contiguous array of `len` elements
+ * @param len The number of elements, at most `BATCH_LEN`
+ * @param hashes Where to store the hash of each element
+ */
+static void prefetch_block(const set_t *set, const uint8_t *elems, size_t len, uint32_t *hashes) {
+    for (size_t i = 0; i < len; i++) {
+        hashes[i] = set->hasher(elems + i * set->elemsize, set->elemsize);
+    }
+    prefetch_hashes(set, hashes, len);
+}
+
+/* Add an element whose hash is already known.
+ * @param set The set to add to
+ * @param elem The element to add
+ * @param hash The hash of `elem`
+ * @return 0 on success, ENOMEM if there was not enough memory to store the element
+ */
+static int add_hashed(set_t *set, const void *elem, uint32_t hash) {
+    size_t i;
+
+    /* Don't add duplicates */
+
+    if (lookup(set, elem, hash, &i)) return 0;
+
+    /* Using up an empty slot might exceed the load limit. Grow if there are many live elements, otherwise just rehash
+     * in place to clear out the deleted slots. Robin Hood insertions always use up an empty slot at the end of the run.
+     */
+
+    if ((set->probing == SET_ROBIN || set->ctrl[i] == CTRL_EMPTY) && set->len + set->tombs + 1 > set->limit) {
+        size_t capacity = (set->len + 1) * 2 > set->limit ? set->capacity * 2 : set->capacity;
+        if (rehash(set, capacity)) return ENOMEM;
+
+        size_t probes;
+        probe(set, elem, hash, &i, &probes);
+    }
+
+    /* Dense sets append the element to the dense array, which may need to grow first */
+
+    if (set->dense && set->len == set->entries_cap) {
+        size_t entries_cap = set->entries_cap ? set->entries_cap * 2 : MIN_CAPACITY;
+        void *entries = realloc(set->entries, entries_cap * set->elemsize);
+        if (entries == NULL) return ENOMEM;
+        set->entries = entries;
+        set->entries_cap = entries_cap;
+    }
+
+    /* Copy element into the slot found by the probe */
+
+    claim(set, i, hash);
+    if (set->dense) *(uint32_t *)slot_ptr(set, i) = set->len;
+    memcpy(get_slot(set, i), elem, set->elemsize);
+    if (set->bloom != NULL) bloom_add(set, hash);
+    set->len++;
+    record_occupancy(set);
+    return 0;
+}
+
+/* Add an element to the set. The backing array grows once the maximum load factor is reached.
+ * @param set The set to add to.
+ * @param elem The element to add.
+ * @return 0 on success, ENOMEM if there was not enough memory to store the element
+ */
+int set_add(set_t *set, const void *elem) { return add_hashed(set, elem, set->hasher(elem, set->elemsize)); }
+
+/* Add many elements to the set at once. Each block of elements is hashed and prefetched before any of it is inserted,
+ * so the cache misses of independent insertions overlap.
+ * @param set The set to add to
+ * @param elems A contiguous array of `n` elements
+ * @param n The number of elements to add
+ * @return 0 on success, ENOMEM if there was not enough memory to store an element. The elements before it were added.
+ */
+int set_add_batch(set_t *set, const void *elems, size_t n) {
+    uint32_t hashes[BATCH_LEN];
+
+    for (size_t start = 0; start < n; start += BATCH_LEN) {
+        size_t len = n - start < BATCH_LEN ? n - start : BATCH_LEN;
+        const uint8_t *block = (const uint8_t *)elems + start * set->elemsize;
+
+        prefetch_block(set, block, len, hashes);
+        for (size_t i = 0; i < len; i++) {
+            if (add_hashed(set, block + i * set->elemsize, hashes[i])) return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/* Remove an element whose hash is already known.
+ * @param set The set to remove from
+ * @param elem The element to remove
+ * @param hash The hash of `elem`
+ */
+static void remove_hashed(set_t *set, const void *elem, uint32_t hash) {
+    size_t i;
+
+    if (!find(set, elem, hash, &i)) return;
+
+    /* A matching element was found, delete it */
+
+    size_t e = set->dense ? *(uint32_t *)slot_ptr(set, i) : 0;
+    release(set, i);
+    set->len--;
+
+    /* Keep the dense array dense by moving its last element into the hole, and pointing that element's slot at its new
+     * index */
+
+    if (set->dense && e != set->len) {
+        void *last = entry(set, set->len);
+        size_t j, probes;
+        probe(set, last, set->hasher(last, set->elemsize), &j, &probes);
+        *(uint32_t *)slot_ptr(set, j) = e;
+        memcpy(entry(set, e), last, set->elemsize);
+    }
+    record_occupancy(set);
+}
+
+/* Remove an element to the set
+ * @param set The set to remove from
+ * @param elem The element to remove
+ */
+void set_remove(set_t *set, const void *elem) { remove_hashed(set, elem, set->hasher(elem, set->elemsize)); }
+
+/* Remove every element from the set, keeping its backing array for reuse. Only the control bytes are reset, which is
+ * one byte per slot and no allocation.
+ * @param set The set to clear
+ */
+void set_clear(set_t *set) {
+    if (set->len == 0 && set->tombs == 0) return;
+
+    memset(set->ctrl, CTRL_EMPTY, set->capacity);
+    if (set->bloom != NULL) memset(set->bloom, 0, set->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    set->len = 0;
+    set->tombs = 0;
+    record_occupancy(set);
+}
+
+/* Ensure the set can hold at least `n` elements without needing to grow.
+ * @param set The set to reserve space in
+ * @param n The number of elements to make space for
+ * @return 0 on success, ENOMEM if the backing array could not be grown
+ */
+int set_reserve(set_t *set, size_t n) {
+    size_t capacity = capacity_for(n, set->max_load);
+    if (capacity <= set->capacity) return 0;
+    return rehash(set, capacity);
+}
+
+/* Shrink the backing array to the smallest capacity that holds the current elements.
+ * @param set The set to shrink
+ * @return 0 on success, ENOMEM if the new backing array could not be allocated
+ */
+int set_shrink_to_fit(set_t *set) {
+
+    /* The dense array can be trimmed in place */
+
+    if (set->dense && set->entries_cap > set->len && set->len > 0) {
+        void *entries = realloc(set->entries, set->len * set->elemsize);
+        if (entries == NULL) return ENOMEM;
+        set->entries = entries;
+        set->entries_cap = set->len;
+    }
+
+    size_t capacity = capacity_for(set->len, set->max_load);
+    if (capacity == set->capacity && set->tombs == 0) return 0;
+    return rehash(set, capacity);
+}
+
+/* Set the maximum load factor of the set, rehashing if the current elements no longer fit.
+ * @param set The set to configure
+ * @param max_load The fraction of the backing array that may be used before it grows, in the range (0, 1]
+ * @return 0 on success, EINVAL if `max_load` is out of range, ENOMEM if a required rehash failed
+ */
+int set_set_max_load(set_t *set, float max_load) {
+    if (!(max_load > 0.0f && max_load <= 1.0f)) {
+        return EINVAL;
+    }
+
+    set->max_load = max_load;
+    set->limit = load_limit(set->capacity, max_load);
+    if (set->len + set->tombs > set->limit) {
+        return rehash(set, capacity_for(set->len, max_load));
+    }
+    return 0;
 }
 
 /* Check if a set contains an element.
@@ -197,59 +754,491 @@ void set_remove(set_t *set, const void *elem) {
  * @return 0 if the element is not in the set, 1 otherwise
  */
 int set_contains(set_t const *set, const void *elem) {
-    size_t index = hash(set, elem);
-    size_t i = index;
-    void *cur;
-    uint8_t *state;
+    size_t i;
+    return find(set, elem, set->hasher(elem, set->elemsize), &i);
+}
 
-    /* Linearly probe for matching slot */
+/* Check if a set contains each of many elements. Each block of elements is hashed and prefetched before any of it is
+ * probed, so the cache misses of independent lookups overlap.
+ * @param set The set to check
+ * @param elems A contiguous array of `n` elements
+ * @param n The number of elements to look for
+ * @param found Where to store 1 for each element in the set and 0 for the others. Pass NULL to only count them.
+ * @return The number of elements that are in the set
+ */
+size_t set_contains_batch(set_t const *set, const void *elems, size_t n, int *found) {
+    uint32_t hashes[BATCH_LEN];
+    size_t count = 0;
 
-    do {
+    for (size_t start = 0; start < n; start += BATCH_LEN) {
+        size_t len = n - start < BATCH_LEN ? n - start : BATCH_LEN;
+        const uint8_t *block = (const uint8_t *)elems + start * set->elemsize;
 
-        /* Get the current slot */
+        prefetch_block(set, block, len, hashes);
+        for (size_t i = 0; i < len; i++) {
+            size_t slot;
+            int in = find(set, block + i * set->elemsize, hashes[i], &slot);
+            if (found != NULL) found[start + i] = in;
+            count += in;
+        }
+    }
 
-        cur = get_slot(set, i, &state);
+    return count;
+}
 
-        /* If an empty slot was found, end here because it means nothing was ever here */
+/* Collect the next block of elements of a set in slot order for a bulk operation, then hash them for the set they will
+ * be probed in and prefetch their probes there. Only the probed set's hash function is ever run, so the set being
+ * walked is never rehashed.
+ * @param set The set to walk
+ * @param i Contains state between calls, as for `set_iter`. Pass with initial value of 0.
+ * @param target The set the elements will be probed in
+ * @param elems Where to store references to up to `BATCH_LEN` elements
+ * @param slots Where to store the slot of each element in `set`, or its index in the dense array if `set` is dense
+ * @param hashes Where to store the hash of each element for `target`
+ * @return The number of elements collected, 0 once the whole set has been walked
+ */
+static size_t next_block(const set_t *set, size_t *i, const set_t *target, void **elems, size_t *slots,
+                         uint32_t *hashes) {
+    size_t len = 0;
+    while (len < BATCH_LEN && set_iter(set, i, &elems[len]) != NULL) {
+        slots[len] = *i - 1;
+        hashes[len] = target->hasher(elems[len], target->elemsize);
+        len++;
+    }
+    prefetch_hashes(target, hashes, len);
+    return len;
+}
 
-        if (*state == SLOT_EMPTY) return 0;
+/* Remove the elements of a set that are, or are not, in another set.
+ * @param set The set to remove from
+ * @param other The set to check the elements against
+ * @param member 1 to remove the elements that are in `other`, 0 to remove the ones that are not
+ * @return 0 on success, ENOMEM if there was not enough memory to hold the elements to remove
+ */
+static int remove_where(set_t *set, const set_t *other, int member) {
+    void *elems[BATCH_LEN];
+    size_t slots[BATCH_LEN];
+    uint32_t hashes[BATCH_LEN];
 
-        /* A matching element was found, success! */
+    /* Grouped probing never moves the other elements of a set on removal, so elements can be removed while the slots
+     * are walked. Robin Hood and dense sets shift elements into the hole, which could move one behind the walk, so
+     * their doomed elements are copied out and removed after the walk. */
 
-        if (*state == SLOT_OCC && !memcmp(cur, elem, set->elemsize)) {
-            return 1;
+    int in_place = set->probing == SET_GROUP && !set->dense;
+    uint8_t *doomed = NULL;
+    size_t ndoomed = 0;
+    size_t doomed_cap = 0;
+
+    size_t i = 0;
+    size_t len;
+    while ((len = next_block(set, &i, other, elems, slots, hashes)) > 0) {
+        for (size_t k = 0; k < len; k++) {
+            size_t slot;
+            if (find(other, elems[k], hashes[k], &slot) != member) continue;
+
+            if (in_place) {
+                release(set, slots[k]);
+                set->len--;
+                continue;
+            }
+
+            if (ndoomed == doomed_cap) {
+                doomed_cap = doomed_cap ? doomed_cap * 2 : BATCH_LEN;
+                uint8_t *grown = realloc(doomed, doomed_cap * set->elemsize);
+                if (grown == NULL) {
+                    free(doomed);
+                    return ENOMEM;
+                }
+                doomed = grown;
+            }
+            memcpy(doomed + ndoomed++ * set->elemsize, elems[k], set->elemsize);
+        }
+    }
+
+    for (size_t k = 0; k < ndoomed; k++) {
+        set_remove(set, doomed + k * set->elemsize);
+    }
+    free(doomed);
+    record_occupancy(set);
+    return 0;
+}
+
+/* Add every element of `src` to `dst`. If `dst` is empty and has the same capacity, hash function and layout as
+ * `src`, the backing arrays are copied slot for slot without hashing anything. Otherwise `dst` grows once up front and
+ * the elements of `src` are added in slot order, a batch at a time.
+ * @param dst The set to add to
+ * @param src The set to add from, holding the same type of element
+ * @return 0 on success, ENOMEM if there was not enough memory to store the elements
+ */
+int set_union_into(set_t *dst, set_t const *src) {
+    if (dst == src) return 0;
+
+    if (dst->len == 0 && dst->capacity == src->capacity && dst->hasher == src->hasher &&
+        dst->probing == src->probing && !dst->dense && !src->dense && src->len + src->tombs <= dst->limit) {
+        memcpy(dst->ctrl, src->ctrl, src->capacity);
+        memcpy(dst->elems, src->elems, src->capacity * src->elemsize);
+        dst->len = src->len;
+        dst->tombs = src->tombs;
+        if (dst->bloom != NULL) bloom_fill(dst);
+        record_occupancy(dst);
+        return 0;
+    }
+
+    if (set_reserve(dst, dst->len + src->len)) return ENOMEM;
+
+    void *elems[BATCH_LEN];
+    size_t slots[BATCH_LEN];
+    uint32_t hashes[BATCH_LEN];
+
+    size_t i = 0;
+    size_t len;
+    while ((len = next_block(src, &i, dst, elems, slots, hashes)) > 0) {
+        for (size_t k = 0; k < len; k++) {
+            if (add_hashed(dst, elems[k], hashes[k])) return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/* Remove every element of `src` from `dst`. Whichever set is smaller is walked, a batch at a time.
+ * @param dst The set to remove from
+ * @param src The set of elements to remove, holding the same type of element
+ * @return 0 on success, ENOMEM if there was not enough memory to hold the elements to remove
+ */
+int set_difference_into(set_t *dst, set_t const *src) {
+    if (dst == src) {
+        set_clear(dst);
+        return 0;
+    }
+
+    if (dst->len < src->len) return remove_where(dst, src, 1);
+
+    /* Walking `src` never changes it, so elements can be removed from `dst` as they are found */
+
+    void *elems[BATCH_LEN];
+    size_t slots[BATCH_LEN];
+    uint32_t hashes[BATCH_LEN];
+
+    size_t i = 0;
+    size_t len;
+    while ((len = next_block(src, &i, dst, elems, slots, hashes)) > 0) {
+        for (size_t k = 0; k < len; k++) {
+            remove_hashed(dst, elems[k], hashes[k]);
+        }
+    }
+    return 0;
+}
+
+/* Remove every element of `dst` that is not in `other`.
+ * @param dst The set to remove from
+ * @param other The set of elements to keep, holding the same type of element
+ * @return 0 on success, ENOMEM if there was not enough memory to hold the elements to remove
+ */
+int set_intersect(set_t *dst, set_t const *other) {
+    if (dst == other) return 0;
+    return remove_where(dst, other, 0);
+}
+
+/* Check if every element of a set is also in another set.
+ * @param set The set to check
+ * @param super The set that should contain every element of `set`, holding the same type of element
+ * @return 1 if `set` is a subset of `super`, 0 otherwise
+ */
+int set_is_subset(set_t const *set, set_t const *super) {
+    if (set == super) return 1;
+    if (set->len > super->len) return 0;
+
+    void *elems[BATCH_LEN];
+    size_t slots[BATCH_LEN];
+    uint32_t hashes[BATCH_LEN];
+
+    size_t i = 0;
+    size_t len;
+    while ((len = next_block(set, &i, super, elems, slots, hashes)) > 0) {
+        for (size_t k = 0; k < len; k++) {
+            size_t slot;
+            if (!find(super, elems[k], hashes[k], &slot)) return 0;
         }
+    }
+    return 1;
+}
 
-        /* If matching slot not found, continue looping */
+/* Change the probing scheme of the set, rehashing the existing elements into the new scheme.
+ * @param set The set to configure
+ * @param probing The probing scheme to use
+ * @return 0 on success, ENOMEM if the rehash failed
+ */
+int set_set_probing(set_t *set, enum set_probe_e probing) {
+    if (set->probing == probing) return 0;
+
+    enum set_probe_e old = set->probing;
+    set->probing = probing;
+    int err = rehash(set, set->capacity);
+    if (err) set->probing = old;
+    return err;
+}
+
+/* Switch the set between storing elements in its slots, and storing them in a separate dense array with the slots only
+ * holding indices into it. Dense sets iterate over just their elements, contiguously and in insertion order, instead of
+ * scanning every slot, at the cost of one extra indirection per lookup.
+ * @param set The set to configure
+ * @param dense 1 to store elements densely, 0 to store them in the slots
+ * @return 0 on success, ENOMEM if the elements could not be moved
+ */
+int set_set_dense(set_t *set, int dense) {
+    dense = dense != 0;
+    if (set->dense == dense) return 0;
 
-        i = (i + 1) % set->capacity; /* Loop around */
+    if (dense) {
 
-    } while (i != index);
+        /* Gather the elements into the dense array, then index them */
 
-    /* We looped until we wrapped back around and found nothing */
+        size_t entries_cap = set->len > MIN_CAPACITY ? set->len : MIN_CAPACITY;
+        void *entries = malloc(entries_cap * set->elemsize);
+        if (entries == NULL) return ENOMEM;
+
+        size_t i = 0;
+        void *elem;
+        for (size_t e = 0; set_iter(set, &i, &elem) != NULL; e++) {
+            memcpy((uint8_t *)entries + e * set->elemsize, elem, set->elemsize);
+        }
+
+        set->entries = entries;
+        set->entries_cap = entries_cap;
+        set->dense = 1;
+        int err = rehash(set, set->capacity);
+        if (err) {
+            set->dense = 0;
+            free(set->entries);
+            set->entries = NULL;
+            set->entries_cap = 0;
+        }
+        return err;
+    }
+
+    /* Move the elements back into the slots */
+
+    set->dense = 0;
+    int err = rehash(set, set->capacity);
+    if (err) {
+        set->dense = 1;
+        return err;
+    }
+    free(set->entries);
+    set->entries = NULL;
+    set->entries_cap = 0;
     return 0;
 }
 
-/* Iterate over elements in the set.
+/* Put a Bloom filter in front of the set, or remove it. The filter answers most lookups for elements that are not in the
+ * set from one cache line, without walking a probe sequence, at the cost of about one byte per element and some extra
+ * work on insertion. It helps when most lookups miss; build with `CONTAINER_STATS` to see how many lookups it rejects.
+ * Removed elements stay in the filter until the backing array is next rebuilt, so heavy removal raises the false
+ * positive rate.
+ * @param set The set to configure
+ * @param enabled 1 to use a filter, 0 to remove it
+ * @return 0 on success, ENOMEM if the filter could not be allocated
+ */
+int set_set_bloom(set_t *set, int enabled) {
+    if ((set->bloom != NULL) == (enabled != 0)) return 0;
+
+    if (!enabled) {
+        free(set->bloom);
+        set->bloom = NULL;
+        set->bloom_blocks = 0;
+        record_occupancy(set);
+        return 0;
+    }
+
+    set->bloom = bloom_alloc(set->limit, &set->bloom_blocks);
+    if (set->bloom == NULL) {
+        set->bloom_blocks = 0;
+        return ENOMEM;
+    }
+    bloom_fill(set);
+    record_occupancy(set);
+    return 0;
+}
+
+/* Measure how many probes it takes to find each element in the set.
+ * @param set The set to measure
+ * @param stats Where to store the statistics. Probe lengths are counted in slots for Robin Hood probing and in groups
+ * of slots for grouped probing.
+ */
+void set_probe_stats(set_t const *set, struct probe_stats *stats) {
+    size_t sum = 0;
+    size_t sum_sq = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (size_t i = 0; i < set->capacity; i++) {
+        if (set->ctrl[i] == CTRL_DEL) stats->tombs++;
+        if (!ctrl_full(set->ctrl[i])) continue;
+
+        size_t probes = 1;
+        if (set->probing == SET_ROBIN) {
+            probes += rh_dist(set, i);
+        } else {
+            struct probeseq seq = probeseq_start(set->hasher(get_slot(set, i), set->elemsize), set->capacity);
+            for (; seq.group != i / GROUP_WIDTH; probeseq_next(&seq)) {
+                probes++;
+            }
+        }
+
+        if (probes > stats->max) stats->max = probes;
+        sum += probes;
+        sum_sq += probes * probes;
+        stats->len++;
+    }
+
+    if (stats->len == 0) return;
+    stats->mean = (double)sum / stats->len;
+    stats->variance = (double)sum_sq / stats->len - stats->mean * stats->mean;
+}
+
+/* Print how full the set is and how long its probe sequences are. When built with `CONTAINER_STATS`, the runtime
+ * counters collected since the set was created are printed too.
+ * @param set The set to report on
+ * @param stream The stream to print to
+ */
+void set_dump_stats(set_t const *set, FILE *stream) {
+    struct probe_stats probes;
+    set_probe_stats(set, &probes);
+
+    fprintf(stream, "set: len %zu, capacity %zu, load %.3f (max %.3f), %zu bytes, %s probing%s\n", set->len,
+            set->capacity, set->capacity ? (double)set->len / set->capacity : 0.0, set->max_load,
+            allocated_bytes(set), set->probing == SET_ROBIN ? "robin hood" : "group", set->dense ? ", dense" : "");
+    stats_print_probes(stream, &probes);
+
+    /* A missing element passes the filter when all of its bits happen to be set, so the share of set bits estimates the
+     * false positive rate */
+
+    if (set->bloom != NULL) {
+        size_t words = set->bloom_blocks * BLOOM_BLOCK_WORDS;
+        size_t bits = 0;
+        for (size_t i = 0; i < words; i++) {
+            bits += __builtin_popcountll(set->bloom[i]);
+        }
+        double fill = (double)bits / (words * 64);
+        double rate = 1.0;
+        for (size_t k = 0; k < BLOOM_HASHES; k++) {
+            rate *= fill;
+        }
+        fprintf(stream, "  bloom filter: %zu blocks, fill %.3f, estimated false positive rate %.4f\n",
+                set->bloom_blocks, fill, rate);
+    }
+
+#ifdef CONTAINER_STATS
+    if (set->stats != NULL) stats_print(stream, set->stats);
+#endif
+}
+
+/* Save the set to a snapshot file, which `set_load_mmap` can map back in without rehashing. The elements are stored as
+ * raw bytes, so they must not hold pointers.
+ * @param set The set to save
+ * @param path The path of the file to write, replaced if it exists
+ * @return 0 on success, ENOTSUP if the set is dense, otherwise the errno of the failed file operation
+ */
+int set_save(set_t const *set, const char *path) {
+    if (set->dense) {
+        return ENOTSUP; /* Snapshots only hold tables with the elements in their slots */
+    }
+
+    struct snapshot_header header = {
+        .kind = SNAPSHOT_SET,
+        .probing = set->probing,
+        .fingerprint = snapshot_fingerprint(set->hasher),
+        .max_load = set->max_load,
+        .capacity = set->capacity,
+        .len = set->len,
+        .tombs = set->tombs,
+        .keysize = set->elemsize,
+        .stride = set->elemsize,
+    };
+    return snapshot_save(path, &header, set->ctrl, set->elems);
+}
+
+/* Create a set from a snapshot file written by `set_save`. The file is mapped into memory rather than read, so this
+ * costs the same no matter how many elements there are, and pages are only loaded as lookups touch them. The set can
+ * be changed like any other; changes never reach the file. The mapping is released once the set is destroyed or its
+ * backing array is rebuilt.
+ * @param set The set to initialize. Left untouched on failure.
+ * @param hasher The hash function the set was saved with. Pass NULL to use `hash_default`
+ * @param elemsize The size of the elements the caller expects, which the snapshot must match
+ * @param path The path of the snapshot file
+ * @return 0 on success, EINVAL if the file is not a set snapshot with this element size usable with this build and
+ * `hasher`, otherwise the errno of the failed file operation
+ */
+int set_load_mmap(set_t *set, hash_f hasher, size_t elemsize, const char *path) {
+    struct snapshot_header header;
+    set_t loaded = {.hasher = hasher == NULL ? hash_default : hasher};
+
+    int err = snapshot_load(path, SNAPSHOT_SET, loaded.hasher, &header, &loaded.ctrl, &loaded.elems,
+                            &loaded.map, &loaded.maplen);
+    if (err) {
+        return err;
+    }
+
+    if (header.keysize != elemsize || header.stride != header.keysize || (header.probing != SET_GROUP && header.probing != SET_ROBIN) ||
+        !(header.max_load > 0.0f && header.max_load <= 1.0f)) {
+        snapshot_unmap(loaded.map, loaded.maplen);
+        return EINVAL;
+    }
+
+    loaded.elemsize = header.keysize;
+    loaded.capacity = header.capacity;
+    loaded.len = header.len;
+    loaded.tombs = header.tombs;
+    loaded.max_load = header.max_load;
+    loaded.limit = load_limit(loaded.capacity, loaded.max_load);
+    loaded.probing = header.probing;
+
+    /* Probing relies on the load limit leaving an empty slot, so a fuller table can't be used */
+
+    if (loaded.len + loaded.tombs > loaded.limit) {
+        snapshot_unmap(loaded.map, loaded.maplen);
+        return EINVAL;
+    }
+    *set = loaded;
+
+    STATS_REGISTER(set, "set");
+    record_occupancy(set);
+    return 0;
+}
+
+/* Iterate over elements in the set. Dense sets are iterated in insertion order, except that removing an element moves
+ * the most recently inserted element into its place.
  * @param set The set to iterate over
  * @param i Contains state between calls. Pass with initial value of 0.
  * @param elem A pointer to where to store the reference to the current element. Pass NULL to just use the return value.
  * @return NULL when all values have been iterated over, same pointer as stored in `elem` otherwise.
  */
 void *set_iter(set_t const *set, size_t *i, void **elem) {
-    uint8_t *state;
     void *cur;
 
-    for (; *i < set->capacity; (*i)++) {
+    /* Dense sets just walk the dense array */
+
+    if (set->dense) {
+        if (*i >= set->len) return NULL;
+        cur = entry(set, (*i)++);
+        if (elem != NULL) *elem = cur;
+        return cur;
+    }
+
+    /* Scan a whole group of control bytes at once, ignoring the slots before `i` that were already visited, so runs of
+     * free slots are skipped without touching the elements */
 
-        /* If something is in this slot, return it */
+    while (*i < set->capacity) {
+        size_t group = *i & ~(size_t)(GROUP_WIDTH - 1);
+        groupmask_t full = group_match_full(set->ctrl + group) & (groupmask_t)(~0u << (*i - group));
 
-        cur = get_slot(set, *i, &state);
-        if (*state == SLOT_OCC) {
+        if (full) {
+            *i = group + group_next(&full);
+            cur = get_slot(set, (*i)++);
             if (elem != NULL) *elem = cur;
-            (*i)++;
             return cur;
         }
+        *i = group + GROUP_WIDTH;
     }
 
     return NULL;
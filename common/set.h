@@ -4,24 +4,69 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-/* Generic hash function */
-typedef uint32_t (*hash_f)(const uint8_t *data, size_t len);
+#include "hash.h"
+#include "stats.h"
 
-/* Represents a set */
+/* Default maximum load factor before the backing array is grown */
+#define SET_DEFAULT_MAX_LOAD 0.875f
+
+/* Probing schemes of a set */
+enum set_probe_e {
+    SET_GROUP, /* Probe whole groups of control bytes at once (default) */
+    SET_ROBIN, /* Robin Hood linear probing with backward-shift deletion, which leaves no deleted markers behind */
+};
+
+/* Represents a set. Each slot has a control byte holding 7 bits of its element's hash, stored apart from the elements
+ * so that lookups can check a whole group of slots at once. The backing array grows once the maximum load factor is
+ * reached, so references returned by `set_iter` are only valid until the next insertion or rehash. A dense set
+ * (`set_set_dense`) keeps its elements in a separate array in insertion order, so iterating only visits live elements.
+ * A set with a Bloom filter (`set_set_bloom`) rejects most lookups for missing elements without probing. */
 typedef struct {
-    size_t elemsize; /* Size of each element */
-    size_t capacity; /* Capacity of backing array */
-    size_t len;      /* Length of the set */
-    hash_f hasher;   /* The hash function to hash elements */
-    void *elems;     /* The elements in the set */
+    size_t elemsize;          /* Size of each element */
+    size_t capacity;          /* Capacity of backing array, always a power of two */
+    size_t len;               /* Length of the set */
+    size_t tombs;             /* Number of slots marked as deleted */
+    size_t limit;             /* Number of occupied + deleted slots allowed before a rehash */
+    float max_load;           /* Maximum load factor of the backing array */
+    hash_f hasher;            /* The hash function to hash elements */
+    enum set_probe_e probing; /* Probing scheme */
+    uint8_t *ctrl;            /* The control byte of each slot */
+    void *elems;              /* The elements in the set, or their indices in `entries` when dense */
+    int dense;                /* 1 if the elements live in `entries` and the slots hold indices into it */
+    void *entries;            /* Dense array of elements in insertion order, only used when dense */
+    size_t entries_cap;       /* Capacity of the dense array in elements */
+    uint64_t *bloom;          /* Blocked Bloom filter of the elements, NULL if disabled */
+    size_t bloom_blocks;      /* Number of cache line sized blocks in the filter, always a power of two */
+    void *map;                /* Snapshot file mapping holding the arrays, NULL if they are on the heap */
+    size_t maplen;            /* Length of the snapshot file mapping */
+#ifdef CONTAINER_STATS
+    struct container_stats *stats; /* Runtime counters */
+#endif
 } set_t;
 
-void set_create(set_t *set, hash_f hasher, size_t init_cap, size_t elemsize);
+int set_create(set_t *set, hash_f hasher, size_t init_cap, size_t elemsize);
 void set_destroy(set_t *set);
 size_t set_len(set_t const *set);
-void set_add(set_t *set, const void *elem);
+int set_add(set_t *set, const void *elem);
+int set_add_batch(set_t *set, const void *elems, size_t n);
 void set_remove(set_t *set, const void *elem);
+void set_clear(set_t *set);
+int set_reserve(set_t *set, size_t n);
+int set_shrink_to_fit(set_t *set);
+int set_set_max_load(set_t *set, float max_load);
 int set_contains(set_t const *set, const void *elem);
+size_t set_contains_batch(set_t const *set, const void *elems, size_t n, int *found);
+int set_union_into(set_t *dst, set_t const *src);
+int set_difference_into(set_t *dst, set_t const *src);
+int set_intersect(set_t *dst, set_t const *other);
+int set_is_subset(set_t const *set, set_t const *super);
 void *set_iter(set_t const *set, size_t *i, void **elem);
+int set_set_probing(set_t *set, enum set_probe_e probing);
+int set_set_dense(set_t *set, int dense);
+int set_set_bloom(set_t *set, int enabled);
+void set_probe_stats(set_t const *set, struct probe_stats *stats);
+void set_dump_stats(set_t const *set, FILE *stream);
+int set_save(set_t const *set, const char *path);
+int set_load_mmap(set_t *set, hash_f hasher, size_t elemsize, const char *path);
 
 #endif // _SET_H_
@@ -0,0 +1,156 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ctrl.h"
+#include "snapshot.h"
+
+/* Identifies snapshot files */
+static const char SNAPSHOT_MAGIC[8] = "AOCSNAP";
+
+/* Round `n` up to a multiple of `SNAPSHOT_ALIGN`.
+ * @param n The number to round
+ * @return `n` rounded up
+ */
+static size_t snapshot_align(size_t n) { return (n + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1); }
+
+/* Get the offset of the control bytes in a snapshot file.
+ * @return The offset in bytes
+ */
+static size_t ctrl_offset(void) { return snapshot_align(sizeof(struct snapshot_header)); }
+
+/* Get the offset of the slots in a snapshot file.
+ * @param header The header of the snapshot
+ * @return The offset in bytes
+ */
+static size_t slots_offset(struct snapshot_header const *header) {
+    return snapshot_align(ctrl_offset() + header->capacity);
+}
+
+/* Fingerprint a hash function, so that a table is never loaded with a different function than it was built with.
+ * Hash functions like `hash_int` treat some key sizes specially, so several sizes are hashed.
+ * @param hasher The hash function to fingerprint
+ * @return A combination of the hashes of a fixed input at several lengths
+ */
+uint32_t snapshot_fingerprint(hash_f hasher) {
+    static const uint8_t input[] = "aoc2024 snapshot fingerprint";
+    static const size_t lens[] = {4, 8, 16, sizeof(input)};
+
+    uint64_t fingerprint = 0;
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        fingerprint = hash_mix64(fingerprint ^ hasher(input, lens[i]));
+    }
+    return fingerprint;
+}
+
+/* Write a table to a snapshot file, replacing the file if it exists. The snapshot is written next to the file and then
+ * renamed over it, so a table mapped from the old file keeps working and a failed save leaves the old file intact.
+ * @param path The path of the file to write
+ * @param header The header describing the table. The magic number and version are filled in.
+ * @param ctrl The table's `capacity` control bytes
+ * @param slots The table's `capacity` slots of `stride` bytes each
+ * @return 0 on success, otherwise the errno of the failed file operation
+ */
+int snapshot_save(const char *path, struct snapshot_header *header, const uint8_t *ctrl, const void *slots) {
+    static const uint8_t padding[SNAPSHOT_ALIGN] = {0};
+
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->group_width = GROUP_WIDTH;
+
+    char tmppath[FILENAME_MAX];
+    if (snprintf(tmppath, sizeof(tmppath), "%s.tmp", path) >= (int)sizeof(tmppath)) {
+        return ENAMETOOLONG;
+    }
+
+    FILE *file = fopen(tmppath, "wb");
+    if (file == NULL) {
+        return errno;
+    }
+
+    size_t ctrl_pad = ctrl_offset() - sizeof(*header);
+    size_t slots_pad = slots_offset(header) - ctrl_offset() - header->capacity;
+
+    int ok = fwrite(header, sizeof(*header), 1, file) == 1 && fwrite(padding, 1, ctrl_pad, file) == ctrl_pad &&
+             fwrite(ctrl, 1, header->capacity, file) == header->capacity &&
+             fwrite(padding, 1, slots_pad, file) == slots_pad &&
+             fwrite(slots, header->stride, header->capacity, file) == header->capacity;
+
+    int err = ok ? 0 : errno;
+    if (fclose(file) && !err) {
+        err = errno;
+    }
+    if (!err && rename(tmppath, path)) {
+        err = errno;
+    }
+    if (err) remove(tmppath);
+    return err;
+}
+
+/* Map a snapshot file into memory. The mapping is private, so the table can be changed freely without the file ever
+ * being written to. Pages are only read from the file as they are touched.
+ * @param path The path of the file to map
+ * @param kind The kind of table expected in the file
+ * @param hasher The hash function the table will be used with
+ * @param header Where to store the snapshot's header
+ * @param ctrl Where to store a reference to the mapped control bytes
+ * @param slots Where to store a reference to the mapped slots
+ * @param map Where to store the start of the mapping, to unmap it with later
+ * @param maplen Where to store the length of the mapping
+ * @return 0 on success, EINVAL if the file is not a snapshot of the expected kind that this program can use as-is,
+ * otherwise the errno of the failed file operation
+ */
+int snapshot_load(const char *path, enum snapshot_kind_e kind, hash_f hasher, struct snapshot_header *header,
+                  uint8_t **ctrl, void **slots, void **map, size_t *maplen) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    /* Check that the header is something we wrote, for this kind of table, probed the way we probe */
+
+    size_t size = st.st_size;
+    if (size < sizeof(*header) || pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) ||
+        memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) || header->version != SNAPSHOT_VERSION ||
+        header->kind != kind || header->group_width != GROUP_WIDTH ||
+        header->fingerprint != snapshot_fingerprint(hasher) || header->capacity < GROUP_WIDTH ||
+        (header->capacity & (header->capacity - 1)) || header->len > header->capacity ||
+        header->tombs > header->capacity - header->len ||
+        size < slots_offset(header) + header->capacity * header->stride) {
+        close(fd);
+        return EINVAL;
+    }
+
+    /* The mapping stays valid after the file is closed */
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    int err = base == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (err) {
+        return err;
+    }
+
+    *ctrl = (uint8_t *)base + ctrl_offset();
+    *slots = (uint8_t *)base + slots_offset(header);
+    *map = base;
+    *maplen = size;
+    return 0;
+}
+
+/* Unmap a snapshot mapped by `snapshot_load`.
+ * @param map The start of the mapping
+ * @param maplen The length of the mapping
+ */
+void snapshot_unmap(void *map, size_t maplen) { munmap(map, maplen); }
@@ -0,0 +1,50 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash.h"
+
+/* Snapshots store a hash table's control bytes and slots exactly as they are laid out in memory, so they can be mapped
+ * back in and used directly without rehashing anything. A snapshot file is the header below, followed by the control
+ * bytes and then the slots, each starting on a `SNAPSHOT_ALIGN` byte boundary.
+ */
+
+/* Bumped whenever the layout of a snapshot or of the tables it stores changes */
+#define SNAPSHOT_VERSION 2
+
+/* Alignment of the arrays inside a snapshot file */
+#define SNAPSHOT_ALIGN 64
+
+/* The kinds of table a snapshot can hold */
+enum snapshot_kind_e {
+    SNAPSHOT_HMAP = 1, /* An `hmap_t` */
+    SNAPSHOT_SET = 2,  /* A `set_t` */
+};
+
+/* Describes the table stored in a snapshot file. */
+struct snapshot_header {
+    char magic[8];        /* Identifies snapshot files */
+    uint32_t version;     /* `SNAPSHOT_VERSION` of the program that wrote the file */
+    uint32_t kind;        /* The kind of table stored */
+    uint32_t group_width; /* `GROUP_WIDTH` of the program that wrote the file, which decides where keys are probed */
+    uint32_t probing;     /* The table's probing scheme */
+    uint32_t fingerprint; /* Output of the table's hash function for a fixed input */
+    float max_load;       /* The table's maximum load factor, if it has one */
+    uint64_t capacity;    /* Number of slots */
+    uint64_t len;         /* Number of full slots */
+    uint64_t tombs;       /* Number of deleted slots, if the table counts them */
+    uint64_t keysize;     /* Size of each key or element */
+    uint64_t valsize;     /* Size of each value, 0 for sets */
+    uint64_t stride;      /* Size of each slot */
+    uint64_t valoff;      /* Offset of the value in each slot */
+};
+
+uint32_t snapshot_fingerprint(hash_f hasher);
+int snapshot_save(const char *path, struct snapshot_header *header, const uint8_t *ctrl, const void *slots);
+int snapshot_load(const char *path, enum snapshot_kind_e kind, hash_f hasher, struct snapshot_header *header,
+                  uint8_t **ctrl, void **slots, void **map, size_t *maplen);
+void snapshot_unmap(void *map, size_t maplen);
+
+#endif // _SNAPSHOT_H_
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+/* Every container registered so far, in creation order */
+static struct container_stats *registry = NULL;
+static struct container_stats **registry_tail = &registry;
+static size_t registered = 0;
+
+/* Print the counters of every registered container if `AOC_STATS` is set, then free them. */
+static void stats_report(void) {
+    int report = getenv("AOC_STATS") != NULL;
+
+    while (registry != NULL) {
+        struct container_stats *next = registry->next;
+        if (report) stats_print(stderr, registry);
+        free(registry);
+        registry = next;
+    }
+    registry_tail = &registry;
+}
+
+/* Start collecting counters for a new container. The counters outlive the container so they can be reported when the
+ * program exits.
+ * @param kind The type of container, used to label reports
+ * @return The counters to update, or NULL if they could not be allocated
+ */
+struct container_stats *stats_register(const char *kind) {
+    struct container_stats *stats = calloc(1, sizeof(struct container_stats));
+    if (stats == NULL) return NULL;
+
+    if (registered == 0) atexit(stats_report);
+
+    stats->kind = kind;
+    stats->id = registered++;
+    *registry_tail = stats;
+    registry_tail = &stats->next;
+    return stats;
+}
+
+/* Record one walk of a probe sequence.
+ * @param stats The counters to update. Nothing is recorded if NULL.
+ * @param probes The length of the probe sequence
+ */
+void stats_probe(struct container_stats *stats, size_t probes) {
+    if (stats == NULL) return;
+
+    stats->lookups++;
+    stats->probes += probes;
+    if (probes > stats->max_probe) stats->max_probe = probes;
+
+    if (probes == 0) probes = 1;
+    if (probes > STATS_HIST_LEN) probes = STATS_HIST_LEN;
+    stats->hist[probes - 1]++;
+}
+
+/* Record how full a container is after its length or capacity changed.
+ * @param stats The counters to update. Nothing is recorded if NULL.
+ * @param len The number of entries in the container
+ * @param capacity The capacity of the container's backing array
+ * @param bytes The number of bytes allocated for the backing array
+ */
+void stats_occupancy(struct container_stats *stats, size_t len, size_t capacity, size_t bytes) {
+    if (stats == NULL) return;
+
+    stats->len = len;
+    if (len > stats->peak_len) stats->peak_len = len;
+    stats->capacity = capacity;
+    stats->bytes = bytes;
+}
+
+/* Record that a container's backing array was rebuilt.
+ * @param stats The counters to update. Nothing is recorded if NULL.
+ */
+void stats_rehash(struct container_stats *stats) {
+    if (stats == NULL) return;
+    stats->rehashes++;
+}
+
+/* Record one lookup that was checked against a membership filter before probing.
+ * @param stats The counters to update. Nothing is recorded if NULL.
+ * @param passed 1 if the filter said the entry might be present, 0 if it rejected the lookup
+ * @param found 1 if the lookup found the entry
+ */
+void stats_filter(struct container_stats *stats, int passed, int found) {
+    if (stats == NULL) return;
+
+    stats->filter_checks++;
+    if (!passed) {
+        stats->filter_rejects++;
+    } else if (!found) {
+        stats->filter_false++;
+    }
+}
+
+/* Record that a container was destroyed. Its counters are kept until the program exits.
+ * @param stats The counters to update. Nothing is recorded if NULL.
+ * @param final The probe lengths of the container's entries right before it was destroyed
+ */
+void stats_destroyed(struct container_stats *stats, struct probe_stats const *final) {
+    if (stats == NULL) return;
+    stats->final = *final;
+    stats->destroyed = 1;
+}
+
+/* Print the probe lengths of the entries in a table.
+ * @param stream The stream to print to
+ * @param probes The probe lengths to print
+ */
+void stats_print_probes(FILE *stream, struct probe_stats const *probes) {
+    fprintf(stream, "  entry probes: max %zu, mean %.3f, variance %.3f, tombstones %zu\n", probes->max, probes->mean,
+            probes->variance, probes->tombs);
+}
+
+/* Print the counters of a container.
+ * @param stream The stream to print to
+ * @param stats The counters to print
+ */
+void stats_print(FILE *stream, struct container_stats const *stats) {
+    double load = stats->capacity ? (double)stats->len / stats->capacity : 0.0;
+    double peak = stats->capacity ? (double)stats->peak_len / stats->capacity : 0.0;
+    double mean = stats->lookups ? (double)stats->probes / stats->lookups : 0.0;
+
+    fprintf(stream, "%s #%zu%s: len %zu (peak %zu), capacity %zu, load %.3f (peak %.3f), %zu bytes\n", stats->kind,
+            stats->id, stats->destroyed ? "" : " (live)", stats->len, stats->peak_len, stats->capacity, load, peak,
+            stats->bytes);
+    fprintf(stream, "  %zu lookups, mean probe %.3f, max probe %zu, %zu rehashes\n", stats->lookups, mean,
+            stats->max_probe, stats->rehashes);
+
+    if (stats->lookups > 0) {
+        fprintf(stream, "  histogram:");
+        for (size_t i = 0; i < STATS_HIST_LEN; i++) {
+            if (stats->hist[i] == 0) continue;
+            fprintf(stream, " %zu%s:%zu", i + 1, i + 1 == STATS_HIST_LEN ? "+" : "", stats->hist[i]);
+        }
+        fprintf(stream, "\n");
+    }
+
+    /* The false positive rate is the share of lookups for missing entries that the filter failed to reject */
+
+    if (stats->filter_checks > 0) {
+        size_t misses = stats->filter_rejects + stats->filter_false;
+        fprintf(stream, "  filter: %zu checks, %zu rejected, %zu false positives (rate %.4f)\n", stats->filter_checks,
+                stats->filter_rejects, stats->filter_false, misses ? (double)stats->filter_false / misses : 0.0);
+    }
+
+    if (stats->destroyed) stats_print_probes(stream, &stats->final);
+}
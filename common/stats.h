@@ -0,0 +1,69 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Probe length statistics of the entries in a hash table. Probe lengths count slots for Robin Hood tables, and groups of
+ * slots for grouped tables. */
+struct probe_stats {
+    size_t len;      /* Number of entries measured */
+    size_t max;      /* Longest probe length of any entry */
+    size_t tombs;    /* Number of deleted markers in the table */
+    double mean;     /* Mean probe length */
+    double variance; /* Variance of probe lengths */
+};
+
+/* Runtime counters are only collected when built with `-DCONTAINER_STATS` (`make STATS=1`). Otherwise the `STATS_*`
+ * hooks below compile to nothing and the containers carry no extra state.
+ * Set the `AOC_STATS` environment variable to print the counters of every container to stderr when the program exits.
+ */
+
+/* Number of buckets in the probe length histogram. The last bucket counts every probe at least that long. */
+#define STATS_HIST_LEN 16
+
+/* Runtime counters of one container. */
+struct container_stats {
+    const char *kind;             /* The type of container, for reports */
+    size_t id;                    /* Order the container was created in, for reports */
+    size_t lookups;               /* Number of probe sequences walked by lookups, insertions and removals */
+    size_t probes;                /* Total length of those probe sequences */
+    size_t hist[STATS_HIST_LEN];  /* Number of probe sequences of each length, starting at one */
+    size_t max_probe;             /* Longest probe sequence walked */
+    size_t rehashes;              /* Number of times the backing array was rebuilt */
+    size_t len;                   /* Number of entries at the last update */
+    size_t peak_len;              /* Most entries ever stored at once */
+    size_t capacity;              /* Capacity of the backing array at the last update */
+    size_t bytes;                 /* Bytes allocated for the backing array at the last update */
+    size_t filter_checks;         /* Number of lookups checked against a membership filter first */
+    size_t filter_rejects;        /* Number of those lookups the filter answered without probing */
+    size_t filter_false;          /* Number of lookups the filter let through that found nothing */
+    struct probe_stats final;     /* Probe lengths of the entries when the container was destroyed */
+    int destroyed;                /* 1 once the container has been destroyed */
+    struct container_stats *next; /* Next container in the report */
+};
+
+struct container_stats *stats_register(const char *kind);
+void stats_probe(struct container_stats *stats, size_t probes);
+void stats_occupancy(struct container_stats *stats, size_t len, size_t capacity, size_t bytes);
+void stats_rehash(struct container_stats *stats);
+void stats_filter(struct container_stats *stats, int passed, int found);
+void stats_destroyed(struct container_stats *stats, struct probe_stats const *final);
+void stats_print_probes(FILE *stream, struct probe_stats const *probes);
+void stats_print(FILE *stream, struct container_stats const *stats);
+
+#ifdef CONTAINER_STATS
+#define STATS_REGISTER(c, kind) ((c)->stats = stats_register(kind))
+#define STATS_PROBE(c, n) stats_probe((c)->stats, (n))
+#define STATS_OCCUPANCY(c, len, cap, bytes) stats_occupancy((c)->stats, (len), (cap), (bytes))
+#define STATS_REHASH(c) stats_rehash((c)->stats)
+#define STATS_FILTER(c, passed, found) stats_filter((c)->stats, (passed), (found))
+#else
+#define STATS_REGISTER(c, kind) ((void)(c))
+#define STATS_PROBE(c, n) ((void)(c), (void)(n))
+#define STATS_OCCUPANCY(c, len, cap, bytes) ((void)(c))
+#define STATS_REHASH(c) ((void)(c))
+#define STATS_FILTER(c, passed, found) ((void)(c), (void)(passed), (void)(found))
+#endif
+
+#endif // _STATS_H_
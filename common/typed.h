@@ -0,0 +1,399 @@
+#ifndef _TYPED_H_
+#define _TYPED_H_
+
+/* Type-specialized containers, generated by macros.
+ *
+ * LIST_DECLARE(intlist, int) declares `intlist_t` along with `intlist_create`, `intlist_append` and friends.
+ * SET_DECLARE(coordset, coord_t) declares `coordset_t`, a set of `coord_t`.
+ * HMAP_DECLARE(stonemap, stone_t, size_t) declares `stonemap_t`, a hash map from `stone_t` to `size_t`.
+ *
+ * Every generated function is `static inline` and knows its element types at compile time, so compares, copies and
+ * hashes become fixed-size loads instead of calls through `memcmp`, `memcpy` and `hash_f`. Elements are passed and
+ * returned by value. Keys are compared and hashed byte-wise, so struct keys must not contain padding.
+ *
+ * The sets and hash maps use the same grouped control bytes as `set_t` and `hmap_t`, and grow once they are 7/8 full.
+ * Pointers into them are valid until the next insertion of a new key, removal or growth.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctrl.h"
+#include "hash.h"
+
+/* Hash a fixed-size key. `len` is a compile-time constant at every call site, so the loops unroll into a few
+ * multiplies for the small integer and coordinate keys used by the solutions.
+ * @param data The key to hash
+ * @param len The size of the key in bytes
+ * @return The hash of the key
+ */
+static inline uint32_t typed_hash(const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ len;
+    uint64_t word;
+
+    for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+        memcpy(&word, bytes, sizeof(uint64_t));
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+
+    for (; len > 0; len--, bytes++) {
+        hash = (hash ^ *bytes) * 0x100000001B3ull;
+    }
+
+    /* Avalanche so both the low control bits and the high group bits depend on every input bit */
+
+    hash = hash_mix64(hash);
+    return hash ^ (hash >> 32);
+}
+
+/* Get the number of full or deleted slots a typed table may have before it must be rehashed.
+ * @param capacity The number of slots in the table
+ * @return The load limit, 7/8 of the capacity
+ */
+static inline size_t typed_limit(size_t capacity) { return capacity - capacity / 8; }
+
+/* Get the smallest table capacity that fits `n` entries.
+ * @param n The number of entries
+ * @return A power of two capacity, at least one group wide
+ */
+static inline size_t typed_capacity_for(size_t n) {
+    size_t capacity = GROUP_WIDTH;
+    while (typed_limit(capacity) < n) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/* Get the capacity to rehash a full typed table into. Tables with many live entries double, while tables full of deleted
+ * slots are rebuilt at the same size.
+ * @param len The number of live entries, including the one about to be inserted
+ * @param capacity The current capacity of the table
+ * @return The capacity to rehash into
+ */
+static inline size_t typed_grow(size_t len, size_t capacity) {
+    return len * 2 > typed_limit(capacity) ? capacity * 2 : capacity;
+}
+
+/* Declare a dynamic array of `T` named `name##_t`. */
+#define LIST_DECLARE(name, T)                                                                                          \
+    typedef struct {                                                                                                   \
+        T *elements;     /* The array of elements */                                                                   \
+        size_t len;      /* The number of stored elements */                                                           \
+        size_t capacity; /* Capacity of backing array, in number of elements */                                        \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline void name##_create(name##_t *list, size_t init_len) {                                                \
+        list->len = 0;                                                                                                 \
+        list->capacity = init_len;                                                                                     \
+        list->elements = malloc(init_len * sizeof(T));                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_destroy(name##_t *list) {                                                                \
+        free(list->elements);                                                                                          \
+        list->elements = NULL;                                                                                         \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline size_t name##_len(name##_t const *list) { return list->len; }                                        \
+                                                                                                                       \
+    static inline int name##_reserve(name##_t *list, size_t n) {                                                       \
+        if (n <= list->capacity) return 0;                                                                             \
+        size_t capacity = list->capacity ? list->capacity : 4;                                                         \
+        while (capacity < n) {                                                                                         \
+            capacity *= 2;                                                                                             \
+        }                                                                                                              \
+        T *elements = realloc(list->elements, capacity * sizeof(T));                                                   \
+        if (elements == NULL) return ENOMEM;                                                                           \
+        list->elements = elements;                                                                                     \
+        list->capacity = capacity;                                                                                     \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_append(name##_t *list, T e) {                                                             \
+        if (list->len == list->capacity) {                                                                             \
+            int err = name##_reserve(list, list->len + 1);                                                             \
+            if (err) return err;                                                                                       \
+        }                                                                                                              \
+        list->elements[list->len++] = e;                                                                               \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline T name##_get(name##_t const *list, size_t i) { return list->elements[i]; }                           \
+                                                                                                                       \
+    static inline T *name##_at(name##_t const *list, size_t i) { return i < list->len ? &list->elements[i] : NULL; }   \
+                                                                                                                       \
+    static inline void name##_set(name##_t *list, size_t i, T e) { list->elements[i] = e; }                            \
+                                                                                                                       \
+    static inline T name##_pop(name##_t *list) { return list->elements[--list->len]; }                                 \
+                                                                                                                       \
+    static inline long long name##_index(name##_t const *list, T e) {                                                  \
+        for (size_t i = 0; i < list->len; i++) {                                                                       \
+            if (!memcmp(&list->elements[i], &e, sizeof(T))) return i;                                                  \
+        }                                                                                                              \
+        return -1;                                                                                                     \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_in(name##_t const *list, T e) { return name##_index(list, e) != -1; }                     \
+                                                                                                                       \
+    static inline void name##_sort(name##_t *list, int (*comparison)(const void *, const void *)) {                    \
+        qsort(list->elements, list->len, sizeof(T), comparison);                                                       \
+    }
+
+/* Declare a set of `T` named `name##_t`. */
+#define SET_DECLARE(name, T)                                                                                           \
+    typedef struct {                                                                                                   \
+        size_t capacity; /* Capacity of backing array, always a power of two */                                        \
+        size_t len;      /* Length of the set */                                                                       \
+        size_t tombs;    /* Number of slots marked as deleted */                                                       \
+        uint8_t *ctrl;   /* The control byte of each slot */                                                           \
+        T *elems;        /* The elements in the set */                                                                 \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline int name##_alloc(name##_t *set, size_t capacity) {                                                   \
+        set->ctrl = ctrl_alloc(capacity);                                                                              \
+        set->elems = malloc(capacity * sizeof(T));                                                                     \
+        if (set->ctrl == NULL || set->elems == NULL) {                                                                 \
+            free(set->ctrl);                                                                                           \
+            free(set->elems);                                                                                          \
+            return ENOMEM;                                                                                             \
+        }                                                                                                              \
+        set->capacity = capacity;                                                                                      \
+        set->tombs = 0;                                                                                                \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_create(name##_t *set, size_t init_cap) {                                                  \
+        set->len = 0;                                                                                                  \
+        int err = name##_alloc(set, typed_capacity_for(init_cap));                                                     \
+        if (err) memset(set, 0, sizeof(*set));                                                                         \
+        return err;                                                                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_destroy(name##_t *set) {                                                                 \
+        free(set->ctrl);                                                                                               \
+        free(set->elems);                                                                                              \
+        memset(set, 0, sizeof(*set));                                                                                  \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline size_t name##_len(name##_t const *set) { return set->len; }                                          \
+                                                                                                                       \
+    static inline int name##_probe(name##_t const *set, T const *e, uint32_t hash, size_t *slot) {                     \
+        struct probeseq seq = probeseq_start(hash, set->capacity);                                                     \
+        int have_free = 0;                                                                                             \
+        for (;; probeseq_next(&seq)) {                                                                                 \
+            size_t offset = probeseq_offset(&seq);                                                                     \
+            groupmask_t match = group_match(set->ctrl + offset, H2(hash));                                             \
+            while (match) {                                                                                            \
+                size_t i = offset + group_next(&match);                                                                \
+                if (!memcmp(&set->elems[i], e, sizeof(T))) {                                                           \
+                    *slot = i;                                                                                         \
+                    return 1;                                                                                          \
+                }                                                                                                      \
+            }                                                                                                          \
+            groupmask_t free = group_match_free(set->ctrl + offset);                                                   \
+            if (!have_free && free) {                                                                                  \
+                *slot = offset + group_next(&free);                                                                    \
+                have_free = 1;                                                                                         \
+            }                                                                                                          \
+            if (group_match_empty(set->ctrl + offset)) return 0;                                                       \
+        }                                                                                                              \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_rehash(name##_t *set, size_t capacity) {                                                  \
+        name##_t old = *set;                                                                                           \
+        if (name##_alloc(set, capacity)) {                                                                             \
+            *set = old;                                                                                                \
+            return ENOMEM;                                                                                             \
+        }                                                                                                              \
+        for (size_t i = 0; i < old.capacity; i++) {                                                                    \
+            if (!ctrl_full(old.ctrl[i])) continue;                                                                     \
+            uint32_t hash = typed_hash(&old.elems[i], sizeof(T));                                                      \
+            size_t j;                                                                                                  \
+            name##_probe(set, &old.elems[i], hash, &j);                                                                \
+            set->ctrl[j] = H2(hash);                                                                                   \
+            set->elems[j] = old.elems[i];                                                                              \
+        }                                                                                                              \
+        free(old.ctrl);                                                                                                \
+        free(old.elems);                                                                                               \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_contains(name##_t const *set, T e) {                                                      \
+        size_t i;                                                                                                      \
+        return name##_probe(set, &e, typed_hash(&e, sizeof(T)), &i);                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_add(name##_t *set, T e) {                                                                 \
+        uint32_t hash = typed_hash(&e, sizeof(T));                                                                     \
+        size_t i;                                                                                                      \
+        if (name##_probe(set, &e, hash, &i)) return 0;                                                                 \
+        if (set->ctrl[i] == CTRL_EMPTY && set->len + set->tombs + 1 > typed_limit(set->capacity)) {                    \
+            int err = name##_rehash(set, typed_grow(set->len + 1, set->capacity));                                     \
+            if (err) return err;                                                                                       \
+            name##_probe(set, &e, hash, &i);                                                                           \
+        }                                                                                                              \
+        if (set->ctrl[i] == CTRL_DEL) set->tombs--;                                                                    \
+        set->ctrl[i] = H2(hash);                                                                                       \
+        set->elems[i] = e;                                                                                             \
+        set->len++;                                                                                                    \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_remove(name##_t *set, T e) {                                                             \
+        size_t i;                                                                                                      \
+        if (!name##_probe(set, &e, typed_hash(&e, sizeof(T)), &i)) return;                                             \
+        if (group_match_empty(set->ctrl + i / GROUP_WIDTH * GROUP_WIDTH)) {                                            \
+            set->ctrl[i] = CTRL_EMPTY;                                                                                 \
+        } else {                                                                                                       \
+            set->ctrl[i] = CTRL_DEL;                                                                                   \
+            set->tombs++;                                                                                              \
+        }                                                                                                              \
+        set->len--;                                                                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline T *name##_iter(name##_t const *set, size_t *i) {                                                     \
+        for (; *i < set->capacity; (*i)++) {                                                                           \
+            if (ctrl_full(set->ctrl[*i])) return &set->elems[(*i)++];                                                  \
+        }                                                                                                              \
+        return NULL;                                                                                                   \
+    }
+
+/* Declare a hash map from `K` to `V` named `name##_t`. */
+#define HMAP_DECLARE(name, K, V)                                                                                       \
+    typedef struct {                                                                                                   \
+        size_t capacity; /* Capacity of backing array in number of pairs, always a power of two */                     \
+        size_t len;      /* Number of key, value pairs stored */                                                       \
+        size_t tombs;    /* Number of pairs marked as deleted */                                                       \
+        uint8_t *ctrl;   /* Control byte of each slot */                                                               \
+        K *keys;         /* Key of each slot */                                                                        \
+        V *vals;         /* Value of each slot */                                                                      \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline int name##_alloc(name##_t *hmap, size_t capacity) {                                                  \
+        hmap->ctrl = ctrl_alloc(capacity);                                                                             \
+        hmap->keys = malloc(capacity * sizeof(K));                                                                     \
+        hmap->vals = malloc(capacity * sizeof(V));                                                                     \
+        if (hmap->ctrl == NULL || hmap->keys == NULL || hmap->vals == NULL) {                                          \
+            free(hmap->ctrl);                                                                                          \
+            free(hmap->keys);                                                                                          \
+            free(hmap->vals);                                                                                          \
+            return ENOMEM;                                                                                             \
+        }                                                                                                              \
+        hmap->capacity = capacity;                                                                                     \
+        hmap->tombs = 0;                                                                                               \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_create(name##_t *hmap, size_t init_cap) {                                                 \
+        hmap->len = 0;                                                                                                 \
+        int err = name##_alloc(hmap, typed_capacity_for(init_cap));                                                    \
+        if (err) memset(hmap, 0, sizeof(*hmap));                                                                       \
+        return err;                                                                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_destroy(name##_t *hmap) {                                                                \
+        free(hmap->ctrl);                                                                                              \
+        free(hmap->keys);                                                                                              \
+        free(hmap->vals);                                                                                              \
+        memset(hmap, 0, sizeof(*hmap));                                                                                \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline size_t name##_len(name##_t const *hmap) { return hmap->len; }                                        \
+                                                                                                                       \
+    static inline int name##_probe(name##_t const *hmap, K const *key, uint32_t hash, size_t *slot) {                  \
+        struct probeseq seq = probeseq_start(hash, hmap->capacity);                                                    \
+        int have_free = 0;                                                                                             \
+        for (;; probeseq_next(&seq)) {                                                                                 \
+            size_t offset = probeseq_offset(&seq);                                                                     \
+            groupmask_t match = group_match(hmap->ctrl + offset, H2(hash));                                            \
+            while (match) {                                                                                            \
+                size_t i = offset + group_next(&match);                                                                \
+                if (!memcmp(&hmap->keys[i], key, sizeof(K))) {                                                         \
+                    *slot = i;                                                                                         \
+                    return 1;                                                                                          \
+                }                                                                                                      \
+            }                                                                                                          \
+            groupmask_t free = group_match_free(hmap->ctrl + offset);                                                  \
+            if (!have_free && free) {                                                                                  \
+                *slot = offset + group_next(&free);                                                                    \
+                have_free = 1;                                                                                         \
+            }                                                                                                          \
+            if (group_match_empty(hmap->ctrl + offset)) return 0;                                                      \
+        }                                                                                                              \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_rehash(name##_t *hmap, size_t capacity) {                                                 \
+        name##_t old = *hmap;                                                                                          \
+        if (name##_alloc(hmap, capacity)) {                                                                            \
+            *hmap = old;                                                                                               \
+            return ENOMEM;                                                                                             \
+        }                                                                                                              \
+        for (size_t i = 0; i < old.capacity; i++) {                                                                    \
+            if (!ctrl_full(old.ctrl[i])) continue;                                                                     \
+            uint32_t hash = typed_hash(&old.keys[i], sizeof(K));                                                       \
+            size_t j;                                                                                                  \
+            name##_probe(hmap, &old.keys[i], hash, &j);                                                                \
+            hmap->ctrl[j] = H2(hash);                                                                                  \
+            hmap->keys[j] = old.keys[i];                                                                               \
+            hmap->vals[j] = old.vals[i];                                                                               \
+        }                                                                                                              \
+        free(old.ctrl);                                                                                                \
+        free(old.keys);                                                                                                \
+        free(old.vals);                                                                                                \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline V *name##_get(name##_t const *hmap, K key) {                                                         \
+        size_t i;                                                                                                      \
+        if (!name##_probe(hmap, &key, typed_hash(&key, sizeof(K)), &i)) return NULL;                                   \
+        return &hmap->vals[i];                                                                                         \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_put(name##_t *hmap, K key, V val) {                                                       \
+        uint32_t hash = typed_hash(&key, sizeof(K));                                                                   \
+        size_t i;                                                                                                      \
+        if (name##_probe(hmap, &key, hash, &i)) {                                                                      \
+            hmap->vals[i] = val;                                                                                       \
+            return 0;                                                                                                  \
+        }                                                                                                              \
+        if (hmap->ctrl[i] == CTRL_EMPTY && hmap->len + hmap->tombs + 1 > typed_limit(hmap->capacity)) {                \
+            int err = name##_rehash(hmap, typed_grow(hmap->len + 1, hmap->capacity));                                  \
+            if (err) return err;                                                                                       \
+            name##_probe(hmap, &key, hash, &i);                                                                        \
+        }                                                                                                              \
+        if (hmap->ctrl[i] == CTRL_DEL) hmap->tombs--;                                                                  \
+        hmap->ctrl[i] = H2(hash);                                                                                      \
+        hmap->keys[i] = key;                                                                                           \
+        hmap->vals[i] = val;                                                                                           \
+        hmap->len++;                                                                                                   \
+        return 0;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_remove(name##_t *hmap, K key) {                                                          \
+        size_t i;                                                                                                      \
+        if (!name##_probe(hmap, &key, typed_hash(&key, sizeof(K)), &i)) return;                                        \
+        if (group_match_empty(hmap->ctrl + i / GROUP_WIDTH * GROUP_WIDTH)) {                                           \
+            hmap->ctrl[i] = CTRL_EMPTY;                                                                                \
+        } else {                                                                                                       \
+            hmap->ctrl[i] = CTRL_DEL;                                                                                  \
+            hmap->tombs++;                                                                                             \
+        }                                                                                                              \
+        hmap->len--;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline int name##_iter(name##_t const *hmap, size_t *i, K **key, V **val) {                                 \
+        for (; *i < hmap->capacity; (*i)++) {                                                                          \
+            if (ctrl_full(hmap->ctrl[*i])) {                                                                           \
+                *key = &hmap->keys[*i];                                                                                \
+                *val = &hmap->vals[*i];                                                                                \
+                (*i)++;                                                                                                \
+                return 1;                                                                                              \
+            }                                                                                                          \
+        }                                                                                                              \
+        return 0;                                                                                                      \
+    }
+
+#endif // _TYPED_H_
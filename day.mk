@@ -1,5 +1,11 @@
 CC = gcc
-CFLAGS = -Wall -Wextra
+CFLAGS = -Wall -Wextra -pthread
+LINK_FLAGS += -pthread
+
+# Collect container statistics with `make STATS=1`, then run with AOC_STATS set to see them
+ifdef STATS
+CFLAGS += -DCONTAINER_STATS
+endif
 
 YEAR = 2024
 DAY = $(lastword $(subst /, ,$(abspath .)))